@@ -42,6 +42,12 @@
 #define NEEDS_DISPATCH_RETAIN_RELEASE 1
 #endif
 
+#if __IPHONE_OS_VERSION_MIN_REQUIRED >= 70000
+#define DISPATCH_DATA_IS_NSDATA 1
+#else                                         // iOS 6.X or earlier
+#define DISPATCH_DATA_IS_NSDATA 0
+#endif
+
 // Error Definitions
 
 extern NSString * const SFTPClientErrorDomain;
@@ -80,12 +86,36 @@ typedef enum {
     eSFTPClientErrorUnableToWriteFile,
     eSFTPClientErrorUnableToMakeDirectory,
     eSFTPClientErrorUnableToRename,
-    eSFTPClientErrorUnableToRemove
+    eSFTPClientErrorUnableToRemove,
+    eSFTPClientErrorRequestTimedOut,
+    eSFTPClientErrorDependencyFailed,
+    eSFTPClientErrorInsufficientLocalSpace,
+    eSFTPClientErrorFileTooLarge,
+    eSFTPClientErrorRemoteCommandFailed
 } eSFTPClientErrorCode;
 
 
+// Request priorities, highest last.  Queued requests run in priority order,
+// first in first out within a priority
+typedef enum {
+    eSFTPClientRequestPriorityBulk = 0,
+    eSFTPClientRequestPriorityNormal,
+    eSFTPClientRequestPriorityInteractive
+} eSFTPClientRequestPriority;
+
+#define SFTPClientRequestPriorityCount (eSFTPClientRequestPriorityInteractive + 1)
+
+// Hashes transfers can compute over the data as it passes through
+typedef enum {
+    eSFTPClientHashAlgorithmNone = 0,
+    eSFTPClientHashAlgorithmMD5,
+    eSFTPClientHashAlgorithmSHA256,
+    eSFTPClientHashAlgorithmCRC32C
+} eSFTPClientHashAlgorithm;
+
 @class DLSFTPFile;
 @class DLSFTPRequest;
+@class DLSFTPTransferProgress;
 
 // Block typedefs
 typedef void(^DLSFTPClientSuccessBlock)(void);
@@ -93,7 +123,12 @@ typedef void(^DLSFTPClientFailureBlock)(NSError *error);
 typedef void(^DLSFTPClientArraySuccessBlock)(NSArray *array); // Array of DLSFTPFile objects
 typedef void(^DLSFTPClientProgressBlock) (unsigned long long bytesReceived, unsigned long long bytesTotal);
 typedef void(^DLSFTPClientFileTransferSuccessBlock)(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime);
+typedef void(^DLSFTPClientDataTransferSuccessBlock)(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime, NSData *data);
+typedef void(^DLSFTPClientDataReceivedBlock)(dispatch_data_t data);
 typedef void(^DLSFTPClientFileMetadataSuccessBlock)(DLSFTPFile *fileOrDirectory);
+typedef void(^DLSFTPClientTransferProgressBlock)(DLSFTPTransferProgress *progress);
+typedef void(^DLSFTPClientDictionarySuccessBlock)(NSDictionary *dictionary);
+typedef void(^DLSFTPClientBatchSuccessBlock)(NSArray *results); // [NSNull null] or NSError per request
 
 @protocol DLSFTPRequestDelegate <NSObject>
 
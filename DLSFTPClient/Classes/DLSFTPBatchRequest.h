@@ -0,0 +1,63 @@
+//
+//  DLSFTPBatchRequest.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPRequest.h"
+
+// Runs many requests as a single request on the connection.  The batch is
+// queued, scheduled and timed out as one unit and runs its requests in order
+// on one SFTP channel, so each costs one hop on the socket queue rather than
+// a trip through the connection's queues.  Requests in a batch must not also
+// be submitted to a connection.  Their own blocks are still invoked if set,
+// but batches of small requests usually leave them nil and read the results
+// from the success block.
+// A request with a retryPolicy is retried in place before the batch moves on,
+// holding the channel through the delay.  A request that is cancelled or
+// times out stops the batch, which fails with its error after the channel is
+// restarted, and is retried from the next request if the batch's own
+// retryPolicy allows
+@interface DLSFTPBatchRequest : DLSFTPRequest
+
+// successBlock receives one entry per request, in order: [NSNull null] if the
+// request succeeded, otherwise its NSError.  failureBlock is only invoked if
+// the batch as a whole fails, e.g. when cancelled, and the requests that have
+// not finished then fail with the same error.  progressBlock reports the
+// number of requests finished and the total
+- (id)initWithRequests:(NSArray *)requests
+          successBlock:(DLSFTPClientBatchSuccessBlock)successBlock
+          failureBlock:(DLSFTPClientFailureBlock)failureBlock
+         progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+@property (nonatomic, readonly, copy) NSArray *requests;
+
+// Only the connection should call this, when a request in the batch finishes
+- (void)request:(DLSFTPRequest *)request didFinishWithFailure:(BOOL)failed;
+
+@end
@@ -0,0 +1,236 @@
+//
+//  DLSFTPBatchRequest.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPBatchRequest.h"
+#import "DLSFTPConnection.h"
+#import "DLSFTPRetryPolicy.h"
+
+@interface DLSFTPBatchRequest ()
+
+@property (nonatomic, readwrite, copy) NSArray *requests;
+@property (nonatomic, strong) NSMutableArray *results;
+@property (nonatomic, strong) DLSFTPRequest *currentRequest;
+// set when a request stopped partway through an sftp operation
+@property (nonatomic, assign) BOOL requestInterrupted;
+@property (nonatomic, copy) DLSFTPClientProgressBlock progressBlock;
+@property (nonatomic) dispatch_source_t progressSource;
+
+@end
+
+@implementation DLSFTPBatchRequest
+
+@synthesize progressSource=_progressSource;
+
+- (id)initWithRequests:(NSArray *)requests
+          successBlock:(DLSFTPClientBatchSuccessBlock)successBlock
+          failureBlock:(DLSFTPClientFailureBlock)failureBlock
+         progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    self = [super init];
+    if (self) {
+        self.requests = requests;
+        self.results = [[NSMutableArray alloc] initWithCapacity:[requests count]];
+        self.successBlock = successBlock;
+        self.failureBlock = failureBlock;
+        self.progressBlock = progressBlock;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_progressSource) {
+        dispatch_source_cancel(_progressSource);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(_progressSource);
+#endif
+        _progressSource = NULL;
+    }
+}
+
+- (void)cancel {
+    [super cancel];
+    [self.currentRequest cancel];
+}
+
+- (void)start {
+    if ([self ready] == NO || [self checkSftp] == NO) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    if (self.progressSource == NULL && self.progressBlock) {
+        // merged counts are coalesced, so progress costs less than a dispatch per request
+        dispatch_source_t progressSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, [self targetCallbackQueue]);
+        __block unsigned long long finishedCount = [self.results count];
+        unsigned long long totalCount = [self.requests count];
+        DLSFTPClientProgressBlock progressBlock = self.progressBlock;
+        dispatch_source_set_event_handler(progressSource, ^{
+            finishedCount += dispatch_source_get_data(progressSource);
+            progressBlock(finishedCount, totalCount);
+        });
+        dispatch_resume(progressSource);
+        self.progressSource = progressSource;
+    }
+    [self startNextRequest];
+}
+
+- (void)startNextRequest {
+    if (self.isCancelled) {
+        self.error = [self cancellationError];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    NSUInteger index = [self.results count];
+    if (index == [self.requests count]) {
+        [self.connection requestDidComplete:self];
+        return;
+    }
+    DLSFTPRequest *request = [self.requests objectAtIndex:index];
+    request.connection = self.connection;
+    request.sftp = self.sftp;
+    request.batchRequest = self;
+    self.currentRequest = request;
+    [request startTimeoutTimer];
+    [request start];
+}
+
+- (BOOL)isInterrupted {
+    return [super isInterrupted] || self.requestInterrupted;
+}
+
+- (void)prepareForRetry {
+    [super prepareForRetry];
+    self.requestInterrupted = NO;
+}
+
+- (void)request:(DLSFTPRequest *)request didFinishWithFailure:(BOOL)failed {
+    self.currentRequest = nil;
+    if (failed && request.isCancelled == NO && [request shouldRetry]) {
+        // retried in place, keeping the channel through the delay
+        NSTimeInterval delay = [request.retryPolicy delayAfterAttempt:request.retryCount + 1];
+        [request prepareForRetry];
+        __weak DLSFTPBatchRequest *weakSelf = self;
+        dispatch_time_t retryTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
+        dispatch_after(retryTime, self.connection.socketQueue, ^{
+            [weakSelf startNextRequest];
+        });
+        return;
+    }
+    if (failed) {
+        // NSNull would read as success, so a failure without an error still gets one
+        NSError *error = request.error;
+        if (error == nil) {
+            error = [request errorWithCode:eSFTPClientErrorUnknown
+                          errorDescription:@"Request failed"
+                           underlyingError:nil];
+        }
+        [request fail];
+        [self.results addObject:error];
+    } else {
+        [request succeed];
+        [self.results addObject:[NSNull null]];
+    }
+    if (self.progressSource) {
+        dispatch_source_merge_data(self.progressSource, 1);
+    }
+    if (failed && request.isCancelled) {
+        // the sftp channel is left mid-operation, so nothing more can run on it
+        // until the connection restarts it
+        self.requestInterrupted = YES;
+        self.error = [self.results lastObject];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    // yield the socket queue before the next request
+    __weak DLSFTPBatchRequest *weakSelf = self;
+    dispatch_async(self.connection.socketQueue, ^{
+        [weakSelf startNextRequest];
+    });
+}
+
+// Cancels the progress source and returns a block reporting the final count,
+// or nil.  The last merge may still be pending when the batch finishes, and
+// cancelling drops it, so the count is reported with the result instead
+- (dispatch_block_t)finishProgress {
+    if (_progressSource == NULL) {
+        return nil;
+    }
+    dispatch_source_cancel(_progressSource);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(_progressSource);
+#endif
+    _progressSource = NULL;
+    DLSFTPClientProgressBlock progressBlock = self.progressBlock;
+    unsigned long long finishedCount = [self.results count];
+    unsigned long long totalCount = [self.requests count];
+    return ^{
+        progressBlock(finishedCount, totalCount);
+    };
+}
+
+- (void)fail {
+    dispatch_block_t progressCallback = [self finishProgress];
+    if (progressCallback) {
+        DLSFTPClientFailureBlock failureBlock = self.failureBlock;
+        self.failureBlock = ^(NSError *error) {
+            progressCallback();
+            if (failureBlock) {
+                failureBlock(error);
+            }
+        };
+    }
+    [super fail];
+    // requests that never ran fail with the batch
+    NSError *error = self.error;
+    for (NSUInteger index = [self.results count]; index < [self.requests count]; index++) {
+        DLSFTPRequest *request = [self.requests objectAtIndex:index];
+        request.error = error;
+        [request fail];
+    }
+}
+
+- (void)succeed {
+    DLSFTPClientBatchSuccessBlock successBlock = self.successBlock;
+    NSArray *results = [self.results copy];
+    dispatch_block_t progressCallback = [self finishProgress];
+    if (successBlock || progressCallback) {
+        [self dispatchCallback:^{
+            if (progressCallback) {
+                progressCallback();
+            }
+            if (successBlock) {
+                successBlock(results);
+            }
+        }];
+    }
+    self.successBlock = nil;
+    self.failureBlock = nil;
+}
+
+@end
@@ -34,6 +34,7 @@
 
 @class DLSFTPFile;
 @class DLSFTPRequest;
+@class DLSFTPPrivateKey;
 
 int waitsocket(int socket_fd, LIBSSH2_SESSION *session);
 
@@ -41,6 +42,38 @@ int waitsocket(int socket_fd, LIBSSH2_SESSION *session);
 
 @property (nonatomic, strong, readonly) dispatch_queue_t socketQueue;
 
+// Queue that connection and request blocks are invoked on, unless a request
+// sets its own.  Defaults to NULL, the default priority global queue.  Set it
+// to a serial queue of your own to avoid hopping through the global queue, or
+// to socketQueue to invoke blocks inline as requests finish.  Blocks invoked
+// on socketQueue must be short, as they delay every request on the connection
+@property (nonatomic, strong) dispatch_queue_t callbackQueue;
+
+// Number of SFTP channels opened on the connection's single SSH session.
+// Queued requests run on whichever channel is free, so up to this many
+// run concurrently without another handshake.  Defaults to 1, applied when
+// connecting, and must not exceed the server's session limit
+// (MaxSessions, 10 by default in OpenSSH)
+@property (nonatomic, assign) NSUInteger sftpChannelCount;
+
+// Number of downloads and uploads that may run at once on each SFTP channel.
+// Each holds its own remote handle, and their chunks take turns on the socket
+// queue, so many medium sized files can share the link.  Defaults to 1
+@property (nonatomic, assign) NSUInteger transfersPerChannel;
+
+// Receive window of each SFTP channel, in bytes.  libssh2 opens channels with
+// a 2 MB window and only ever replenishes them to that size, which limits the
+// data in flight per round trip.  Larger values keep more data in flight on
+// high latency links.  0, the default, leaves libssh2's window alone.
+// libssh2_sftp_init offers no way to change the channel's maximum packet
+// size, so transferBufferSize is the matching knob for SFTP transfers
+@property (nonatomic, assign) unsigned long channelWindowSize;
+
+// Bytes passed to each libssh2_sftp_read or libssh2_sftp_write call.  libssh2
+// pipelines one call into several SFTP packets, so larger buffers keep more
+// requests outstanding.  Defaults to 8192
+@property (nonatomic, assign) size_t transferBufferSize;
+
 #pragma mark Connection
 
 - (id)initWithHostname:(NSString *)hostname
@@ -63,17 +96,43 @@ int waitsocket(int socket_fd, LIBSSH2_SESSION *session);
                keypath:(NSString *)keypath
             passphrase:(NSString *)passphrase;
 
+// The key is used from memory, so many connections can share one
+// DLSFTPPrivateKey without reading or decrypting it again
+- (id)initWithHostname:(NSString *)hostname
+                  port:(NSUInteger)port
+              username:(NSString *)username
+            privateKey:(DLSFTPPrivateKey *)privateKey;
+
 - (void)connectWithSuccessBlock:(DLSFTPClientSuccessBlock)successBlock
                    failureBlock:(DLSFTPClientFailureBlock)failureBlock;
 
 - (void)disconnect;
+// Cancels the running requests, and fails every other request with
+// eSFTPClientErrorCancelledByUser
 - (void)cancelAllRequests;
 - (BOOL)isConnected;
 
 # pragma mark - Request
 
 - (NSUInteger)requestCount;
+// Requests start in order of priority, then in the order they were submitted.
+// A request with higher priority than the transfers running on a channel runs
+// between their chunks instead of waiting for them to finish.  Requests with
+// unfinished dependencies are held until their dependencies have succeeded
 - (void)submitRequest:(DLSFTPRequest *)request;
+// Cancels the request if it is running, so it fails with a cancellation error
+// once its current step returns, otherwise removes it from the queue in constant
+// time, without calling its blocks.  Requests depending on it fail
 - (void)removeRequest:(DLSFTPRequest *)request;
 
+// Only requests should call this, on the socket queue, as they read
+- (void)adjustReceiveWindowOfSftp:(LIBSSH2_SFTP *)sftp;
+// Wakes any waitsocket blocked on this connection's session. Safe to call from any thread
+- (void)wakeup;
+// YES if called on this connection's socketQueue
+- (BOOL)isOnSocketQueue;
+// Invokes the block on queue, directly if queue is socketQueue and this is
+// called on it, otherwise asynchronously
+- (void)dispatchCallback:(dispatch_block_t)block toQueue:(dispatch_queue_t)queue;
+
 @end
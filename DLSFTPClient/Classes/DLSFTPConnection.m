@@ -36,6 +36,9 @@
 #include "libssh2_sftp.h"
 #import "DLSFTPConnection.h"
 #import "DLSFTPRequest.h"
+#import "DLSFTPPrivateKey.h"
+#import "DLSFTPRequestQueue.h"
+#import "DLSFTPBatchRequest.h"
 #import <CFNetwork/CFNetwork.h>
 
 // disconnection callback
@@ -50,8 +53,65 @@ NSString * const SFTPClientUnderlyingErrorKey = @"SFTPClientUnderlyingError";
 static const NSUInteger cDefaultSSHPort = 22;
 static const NSTimeInterval cDefaultConnectionTimeout = 15.0;
 static const NSTimeInterval cIdleTimeout = 60.0;
+static const size_t cDefaultTransferBufferSize = 8192;
+// identifies each connection's socket queue, to detect when running on it
+static char cSocketQueueKey;
 static NSString * const SFTPClientCompleteRequestException = @"SFTPClientCompleteRequestException";
 
+// authentication method names, as returned by libssh2_userauth_list
+static NSString * const cAuthMethodPublicKey = @"publickey";
+static NSString * const cAuthMethodPassword = @"password";
+static NSString * const cAuthMethodKeyboardInteractive = @"keyboard-interactive";
+
+// An SFTP subsystem channel on the connection's session.  It runs one request at a
+// time, except that higher priority requests may preempt running transfers
+@interface DLSFTPChannel : NSObject
+
+@property (nonatomic, assign) LIBSSH2_SFTP *sftp;
+@property (nonatomic, strong) NSMutableArray *runningRequests;
+// set when a request stopped part way, until the SFTP subsystem is restarted
+@property (nonatomic, assign) BOOL needsRestart;
+@property (nonatomic, assign) BOOL restarting;
+
+@end
+
+@implementation DLSFTPChannel
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.runningRequests = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (BOOL)isIdle {
+    return [self.runningRequests count] == 0;
+}
+
+// Transfers yield the socket queue between chunks, so while only transfers are running
+// another request can run in between, pausing them until it finishes
+- (BOOL)isPreemptible {
+    if ([self isIdle]) {
+        return NO;
+    }
+    for (DLSFTPRequest *request in self.runningRequests) {
+        if ([request isPreemptible] == NO) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (eSFTPClientRequestPriority)priority {
+    eSFTPClientRequestPriority priority = eSFTPClientRequestPriorityBulk;
+    for (DLSFTPRequest *request in self.runningRequests) {
+        priority = MAX(priority, request.priority);
+    }
+    return priority;
+}
+
+@end
 
 @interface DLSFTPConnection () {
 
@@ -66,6 +126,9 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 
     // socket source
     dispatch_source_t _writeSource;
+
+    // self-pipe that wakes waitsocket when requests are cancelled
+    int _wakeupFDs[2];
 }
 
 // socket queue, needed by requests
@@ -77,24 +140,26 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 @property (nonatomic, copy) NSString *username;
 @property (nonatomic, copy) NSString *password;
 @property (nonatomic, copy) NSString *keypath;
+@property (nonatomic, strong) DLSFTPPrivateKey *privateKey;
 @property (nonatomic, copy) NSString *hostname;
 @property (nonatomic, assign) NSUInteger port;
 
 @property (nonatomic, assign) int socket;
 @property (nonatomic, strong) dispatch_source_t timeoutTimer;
 @property (nonatomic, assign) LIBSSH2_SESSION *session;
-@property (nonatomic, assign) LIBSSH2_SFTP *sftp;
 
 // Request handling
-@property (nonatomic, strong) NSMutableArray *requests;
-@property (nonatomic, strong) DLSFTPRequest *currentRequest;
+@property (nonatomic, strong) DLSFTPRequestQueue *requests;
+@property (nonatomic, strong) NSMutableArray *channels; // DLSFTPChannel, accessed on the request queue
+@property (nonatomic, strong) NSMutableSet *pendingRetries; // failed requests waiting to be queued again
+@property (nonatomic, strong) NSMapTable *waitingRequests; // request to NSNumber count of unfinished dependencies
+@property (nonatomic, strong) NSMapTable *dependents; // request to NSMutableArray of waiting requests depending on it
 @end
 
 
 @implementation DLSFTPConnection
 
 @synthesize session=_session;
-@synthesize sftp=_sftp;
 
 #pragma mark Lifecycle
 
@@ -150,6 +215,20 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                           keypath:keypath];
 }
 
+- (id)initWithHostname:(NSString *)hostname
+                  port:(NSUInteger)port
+              username:(NSString *)username
+            privateKey:(DLSFTPPrivateKey *)privateKey {
+    self = [self initWithHostname:hostname
+                             port:port
+                         username:username
+                         password:nil
+                          keypath:nil];
+    if (self) {
+        self.privateKey = privateKey;
+    }
+    return self;
+}
 
 - (id)initWithHostname:(NSString *)hostname
                   port:(NSUInteger)port
@@ -164,17 +243,41 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
         self.password = password;
         self.keypath = keypath;
         self.socket = -1;
-        self.requests = [[NSMutableArray alloc] init];
+        self.requests = [[DLSFTPRequestQueue alloc] init];
+        self.channels = [[NSMutableArray alloc] initWithObjects:[[DLSFTPChannel alloc] init], nil];
+        self.pendingRetries = [[NSMutableSet alloc] init];
+        self.waitingRequests = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                                     valueOptions:NSPointerFunctionsStrongMemory];
+        self.dependents = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                                valueOptions:NSPointerFunctionsStrongMemory];
+        _sftpChannelCount = 1;
+        _transfersPerChannel = 1;
+        _transferBufferSize = cDefaultTransferBufferSize;
         self.socketQueue = dispatch_queue_create("com.hammockdistrict.SFTPClient.socket", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(self.socketQueue, &cSocketQueueKey, (__bridge void *)self, NULL);
         _requestQueue = dispatch_queue_create("com.hammockdistrict.SFTPClient.request", DISPATCH_QUEUE_CONCURRENT);
         _connectionGroup = dispatch_group_create();
         _idleTimer = NULL; // lazily loaded
+        if (pipe(_wakeupFDs) == 0) {
+            fcntl(_wakeupFDs[0], F_SETFL, fcntl(_wakeupFDs[0], F_GETFL) | O_NONBLOCK);
+            fcntl(_wakeupFDs[1], F_SETFL, fcntl(_wakeupFDs[1], F_GETFL) | O_NONBLOCK);
+        } else {
+            NSLog(@"Error creating wakeup pipe: %d", errno);
+            _wakeupFDs[0] = _wakeupFDs[1] = -1;
+        }
     }
     return self;
 }
 
 - (void)dealloc {
-    [self _disconnect];
+    // the last reference may be released in a block on the request queue, so
+    // the channels are read directly rather than synchronously on that queue.
+    // Nothing else can reach them now
+    [self _disconnectChannels:[_channels copy]];
+    if (_wakeupFDs[0] >= 0) {
+        close(_wakeupFDs[0]);
+        close(_wakeupFDs[1]);
+    }
     #if NEEDS_DISPATCH_RETAIN_RELEASE
     dispatch_release(_requestQueue);
     _requestQueue = NULL;
@@ -192,6 +295,35 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 - (dispatch_queue_t)requestQueue {
     return _requestQueue;
 }
+
+- (int)wakeupFD {
+    return _wakeupFDs[0];
+}
+
+- (BOOL)isOnSocketQueue {
+    return dispatch_get_specific(&cSocketQueueKey) == (__bridge void *)self;
+}
+
+- (void)dispatchCallback:(dispatch_block_t)block toQueue:(dispatch_queue_t)queue {
+    if (queue == self.socketQueue && [self isOnSocketQueue]) {
+        block();
+    } else {
+        dispatch_async(queue, block);
+    }
+}
+
+// the queue for connection blocks
+- (dispatch_queue_t)targetCallbackQueue {
+    return self.callbackQueue ?: dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+}
+
+- (void)wakeup {
+    if (_wakeupFDs[1] >= 0) {
+        // if the pipe is full, a wakeup is already pending
+        char byte = 0;
+        write(_wakeupFDs[1], &byte, 1);
+    }
+}
 - (dispatch_source_t)writeSource {
     return _writeSource;
 }
@@ -235,30 +367,120 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
     return _session;
 }
 
+- (NSArray *)allChannels {
+    __block NSArray *allChannels = nil;
+    NSMutableArray *channels = self.channels;
+    dispatch_sync(_requestQueue, ^{
+        allChannels = [channels copy];
+    });
+    return allChannels;
+}
+
 - (void)shutdownSftp {
-    if (_sftp) {
-        while (libssh2_sftp_shutdown(_sftp) == LIBSSH2SFTP_EAGAIN) {
-            waitsocket(self.socket, _session);
+    [self shutdownSftpOnChannels:[self allChannels]];
+}
+
+- (void)shutdownSftpOnChannels:(NSArray *)channels {
+    for (DLSFTPChannel *channel in channels) {
+        if (channel.sftp) {
+            while (libssh2_sftp_shutdown(channel.sftp) == LIBSSH2SFTP_EAGAIN) {
+                waitsocket(self.socket, _session);
+            }
+            channel.sftp = NULL;
         }
-        self.sftp = NULL;
     }
 }
 
-// If there's an error initializing sftp, such as a non-authenticated connection, this will return NULL and we must check the session error
-- (LIBSSH2_SFTP *)sftp {
-    if (_sftp == NULL) {
-        LIBSSH2_SESSION *session = self.session;
-        // initialize sftp in non-blocking
-        // Hack to limit the number of tries here, because
-        // hosts without SFTP trigger an infinite loop
-        int retries = 0, max = 10;
-        while (   (_sftp = libssh2_sftp_init(session)) == NULL
-               && (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
-               && (retries++ < max)) {
-            waitsocket(self.socket, session);
+// Initializes the SFTP subsystem on each channel of an authenticated session.  Called on the
+// socket queue as the last phase of connecting, so requests never pay for opening a channel.
+// Bounded by the connection timeout, because hosts without SFTP can keep returning EAGAIN
+- (BOOL)startSftp {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:cDefaultConnectionTimeout];
+    for (DLSFTPChannel *channel in [self allChannels]) {
+        if ([self startSftpOnChannel:channel deadline:deadline] == NO) {
+            return NO;
         }
     }
-    return _sftp;
+    return YES;
+}
+
+- (BOOL)startSftpOnChannel:(DLSFTPChannel *)channel deadline:(NSDate *)deadline {
+    LIBSSH2_SESSION *session = self.session;
+    LIBSSH2_SFTP *sftp = NULL;
+    while (   (sftp = libssh2_sftp_init(session)) == NULL
+           && (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
+           && self.isConnected
+           && [deadline timeIntervalSinceNow] > 0) {
+        waitsocket(self.socket, session);
+    }
+    channel.sftp = sftp;
+    if (sftp == NULL) {
+        return NO;
+    }
+    [self adjustReceiveWindowOfSftp:sftp];
+    return YES;
+}
+
+// Called on the socket queue.  A cancelled or timed out request may have
+// stopped part way through an SFTP operation, leaving libssh2's state for it on
+// the channel, where the next operation would pick it up.  So the channel's
+// SFTP subsystem is shut down and started again before it runs anything else
+- (void)restartSftpOnChannel:(DLSFTPChannel *)channel {
+    if (channel.sftp == NULL || self.isConnected == NO) {
+        return;
+    }
+    LIBSSH2_SESSION *session = self.session;
+    while (   libssh2_sftp_shutdown(channel.sftp) == LIBSSH2SFTP_EAGAIN
+           && self.isConnected) {
+        waitsocket(self.socket, session);
+    }
+    channel.sftp = NULL;
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:cDefaultConnectionTimeout];
+    if ([self startSftpOnChannel:channel deadline:deadline] == NO) {
+        NSLog(@"Unable to restart SFTP channel: %d", libssh2_session_last_errno(session));
+    }
+}
+
+// Grows the receive window of an sftp channel to channelWindowSize, once a quarter
+// of it has been used.  libssh2 itself only replenishes up to its default window
+- (void)adjustReceiveWindowOfSftp:(LIBSSH2_SFTP *)sftp {
+    unsigned long windowSize = self.channelWindowSize;
+    if (windowSize <= LIBSSH2_CHANNEL_WINDOW_DEFAULT || sftp == NULL) {
+        return;
+    }
+    LIBSSH2_CHANNEL *channel = libssh2_sftp_get_channel(sftp);
+    unsigned long window = libssh2_channel_window_read_ex(channel, NULL, NULL);
+    if (window >= windowSize / 4 * 3) {
+        return;
+    }
+    LIBSSH2_SESSION *session = self.session;
+    unsigned int storewindow = 0;
+    while (   libssh2_channel_receive_window_adjust2(channel, windowSize - window, 0, &storewindow) == LIBSSH2_ERROR_EAGAIN
+           && self.isConnected) {
+        waitsocket(self.socket, session);
+    }
+}
+
+// the first channel's sftp, for callers that aren't running on a channel
+- (LIBSSH2_SFTP *)sftp {
+    DLSFTPChannel *channel = [[self allChannels] objectAtIndex:0];
+    return channel.sftp;
+}
+
+// adds or removes idle channels to match sftpChannelCount, before connecting
+- (void)updateChannels {
+    NSUInteger channelCount = MAX(self.sftpChannelCount, 1u);
+    __weak DLSFTPConnection *weakSelf = self;
+    dispatch_barrier_sync(_requestQueue, ^{
+        NSMutableArray *channels = weakSelf.channels;
+        while ([channels count] < channelCount) {
+            [channels addObject:[[DLSFTPChannel alloc] init]];
+        }
+        while (   [channels count] > channelCount
+               && [[channels lastObject] isIdle]) {
+            [channels removeLastObject];
+        }
+    });
 }
 
 #pragma mark - Private
@@ -269,13 +491,17 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 }
 
 - (void)_disconnect {
+    [self _disconnectChannels:[self allChannels]];
+}
+
+- (void)_disconnectChannels:(NSArray *)channels {
     if (_idleTimer) { // avoid cancelling after dealloc
         [self cancelIdleTimer];
     }
     if (_writeSource && dispatch_source_testcancel(_writeSource) == 0) {
         dispatch_source_cancel(_writeSource);
     }
-    [self shutdownSftp];
+    [self shutdownSftpOnChannels:channels];
     [self disconnectSession];
     if (self.socket >= 0) {
         if(close(self.socket) == -1) {
@@ -337,9 +563,9 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                                              userInfo:@{ NSLocalizedDescriptionKey : errorDescription, SFTPClientUnderlyingErrorKey : @(result) }];
             if (weakSelf.connectionFailureBlock) {
                 DLSFTPClientFailureBlock failureBlock = weakSelf.connectionFailureBlock;
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [weakSelf dispatchCallback:^{
                     failureBlock(error);
-                });
+                } toQueue:[weakSelf targetCallbackQueue]];
             }
             [weakSelf clearConnectionBlocks];
             return;
@@ -349,31 +575,47 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 
         // waitsocket just waits for the socket.  shouldn't use much CPU or anything and lets us be efficient about retrying a potentially blocking operation
 
-        // get user auth methods
-        char * authmethods = NULL;
-        while (   (authmethods = libssh2_userauth_list(session, [self.username UTF8String], strlen([self.username UTF8String]))) == NULL
-               && (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
-               && weakSelf.isConnected) {
-            waitsocket(socketFD, session);
+        // try the method that last worked for this host, which skips the userauth_list round trip
+        NSString *authCacheKey = [weakSelf authMethodCacheKey];
+        NSString *authMethod = [DLSFTPConnection cachedAuthMethodForKey:authCacheKey];
+        NSString *failedAuthMethod = nil;
+        if (authMethod && [weakSelf canAuthenticateWithMethod:authMethod]) {
+            result = [weakSelf authenticateWithMethod:authMethod];
+            if (libssh2_userauth_authenticated(session) == 0) {
+                [DLSFTPConnection cacheAuthMethod:nil forKey:authCacheKey];
+                failedAuthMethod = authMethod;
+                authMethod = nil;
+            }
+        } else {
+            authMethod = nil;
         }
 
-        if (authmethods && strstr(authmethods, "publickey") && self.keypath) {
-            while (   (result = libssh2_userauth_publickey_fromfile(session, [self.username UTF8String], NULL, [self.keypath UTF8String], [self.password UTF8String]) == LIBSSH2_ERROR_EAGAIN)
+        if (authMethod == nil && weakSelf.isConnected) {
+            // get user auth methods
+            char * authmethods = NULL;
+            while (   (authmethods = libssh2_userauth_list(session, [self.username UTF8String], strlen([self.username UTF8String]))) == NULL
+                   && (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
                    && weakSelf.isConnected) {
                 waitsocket(socketFD, session);
             }
-        } else if (authmethods && strstr(authmethods, "password")) {
-            while (   (result = libssh2_userauth_password(session, [self.username UTF8String], [self.password UTF8String]) == LIBSSH2_ERROR_EAGAIN)
-                   && weakSelf.isConnected) {
-                waitsocket(socketFD, session);
+
+            // in order of preference, skipping the cached method that just failed
+            NSArray *preferredMethods = @[ cAuthMethodPublicKey, cAuthMethodPassword, cAuthMethodKeyboardInteractive ];
+            for (NSString *method in preferredMethods) {
+                if (   authmethods
+                    && strstr(authmethods, [method UTF8String])
+                    && [method isEqualToString:failedAuthMethod] == NO
+                    && [weakSelf canAuthenticateWithMethod:method]) {
+                    authMethod = method;
+                    break;
+                }
             }
-        } else if(authmethods && strstr(authmethods, "keyboard-interactive")) {
-            while (   (result = libssh2_userauth_keyboard_interactive(session, [_username UTF8String], response) == LIBSSH2_ERROR_EAGAIN)
-                   && weakSelf.isConnected) {
-                waitsocket(socketFD, session);
+
+            if (authMethod) {
+                result = [weakSelf authenticateWithMethod:authMethod];
+            } else {
+                result = LIBSSH2_ERROR_METHOD_NONE;
             }
-        } else {
-            result = LIBSSH2_ERROR_METHOD_NONE;
         }
 
         if (libssh2_userauth_authenticated(session) == 0) {
@@ -386,43 +628,234 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                                              userInfo:@{ NSLocalizedDescriptionKey : errorDescription, SFTPClientUnderlyingErrorKey : @(result) }];
             if (weakSelf.connectionFailureBlock) {
                 DLSFTPClientFailureBlock failureBlock = weakSelf.connectionFailureBlock;
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [weakSelf dispatchCallback:^{
                     failureBlock(error);
-                });
+                } toQueue:[weakSelf targetCallbackQueue]];
             }
             [weakSelf clearConnectionBlocks];
             return;
         }
         // authentication succeeded
-        // session is now created and we can use it
+        [DLSFTPConnection cacheAuthMethod:authMethod forKey:authCacheKey];
+
+        // start sftp before reporting the connection as ready
+        if ([weakSelf startSftp] == NO) {
+            result = libssh2_session_last_errno(session);
+            [weakSelf _disconnect];
+            NSString *errorDescription = [NSString stringWithFormat:@"Unable to initialize sftp: libssh2 session error %ld", result];
+            NSError *error = [NSError errorWithDomain:SFTPClientErrorDomain
+                                                 code:eSFTPClientErrorUnableToInitializeSFTP
+                                             userInfo:@{ NSLocalizedDescriptionKey : errorDescription, SFTPClientUnderlyingErrorKey : @(result) }];
+            if (weakSelf.connectionFailureBlock) {
+                DLSFTPClientFailureBlock failureBlock = weakSelf.connectionFailureBlock;
+                [weakSelf dispatchCallback:^{
+                    failureBlock(error);
+                } toQueue:[weakSelf targetCallbackQueue]];
+            }
+            [weakSelf clearConnectionBlocks];
+            return;
+        }
+
+        // session and sftp are now created and we can use them
         if (weakSelf.connectionSuccessBlock) {
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), weakSelf.connectionSuccessBlock);
+            [weakSelf dispatchCallback:weakSelf.connectionSuccessBlock toQueue:[weakSelf targetCallbackQueue]];
         }
         [weakSelf clearConnectionBlocks];
         return;
     });
 }
 
+// YES if the connection has the credentials authMethod needs
+- (BOOL)canAuthenticateWithMethod:(NSString *)authMethod {
+    if ([authMethod isEqualToString:cAuthMethodPublicKey]) {
+        return self.privateKey != nil || self.keypath != nil;
+    } else if (   [authMethod isEqualToString:cAuthMethodPassword]
+               || [authMethod isEqualToString:cAuthMethodKeyboardInteractive]) {
+        return self.password != nil;
+    }
+    return NO;
+}
+
+- (int)authenticateWithMethod:(NSString *)authMethod {
+    LIBSSH2_SESSION *session = self.session;
+    int socketFD = self.socket;
+    const char *username = [self.username UTF8String];
+    int result = LIBSSH2_ERROR_METHOD_NONE;
+    if ([authMethod isEqualToString:cAuthMethodPublicKey] && self.privateKey) {
+        NSData *keyData = self.privateKey.keyData;
+        while (   (result = libssh2_userauth_publickey_frommemory(session, username, strlen(username), NULL, 0, [keyData bytes], [keyData length], [self.privateKey.passphrase UTF8String])) == LIBSSH2_ERROR_EAGAIN
+               && self.isConnected) {
+            waitsocket(socketFD, session);
+        }
+    } else if ([authMethod isEqualToString:cAuthMethodPublicKey] && self.keypath) {
+        while (   (result = libssh2_userauth_publickey_fromfile(session, username, NULL, [self.keypath UTF8String], [self.password UTF8String])) == LIBSSH2_ERROR_EAGAIN
+               && self.isConnected) {
+            waitsocket(socketFD, session);
+        }
+    } else if ([authMethod isEqualToString:cAuthMethodPassword]) {
+        while (   (result = libssh2_userauth_password(session, username, [self.password UTF8String])) == LIBSSH2_ERROR_EAGAIN
+               && self.isConnected) {
+            waitsocket(socketFD, session);
+        }
+    } else if ([authMethod isEqualToString:cAuthMethodKeyboardInteractive]) {
+        while (   (result = libssh2_userauth_keyboard_interactive(session, username, response)) == LIBSSH2_ERROR_EAGAIN
+               && self.isConnected) {
+            waitsocket(socketFD, session);
+        }
+    }
+    return result;
+}
+
+#pragma mark Authentication method cache
+
+// includes the kinds of credential supplied, so a method cached by a connection
+// with a password is not tried by one with only a key
+- (NSString *)authMethodCacheKey {
+    NSMutableArray *credentials = [NSMutableArray array];
+    if (self.privateKey || self.keypath) {
+        [credentials addObject:cAuthMethodPublicKey];
+    }
+    if (self.password) {
+        [credentials addObject:cAuthMethodPassword];
+    }
+    return [NSString stringWithFormat:@"%@@%@:%lu/%@", self.username, self.hostname, (unsigned long)self.port, [credentials componentsJoinedByString:@","]];
+}
+
+// last successful authentication method by user, host and port, shared by all connections
++ (NSMutableDictionary *)authMethodCache {
+    static NSMutableDictionary *authMethodCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        authMethodCache = [[NSMutableDictionary alloc] init];
+    });
+    return authMethodCache;
+}
+
++ (NSString *)cachedAuthMethodForKey:(NSString *)key {
+    NSMutableDictionary *authMethodCache = [self authMethodCache];
+    @synchronized(authMethodCache) {
+        return [authMethodCache objectForKey:key];
+    }
+}
+
++ (void)cacheAuthMethod:(NSString *)authMethod forKey:(NSString *)key {
+    NSMutableDictionary *authMethodCache = [self authMethodCache];
+    @synchronized(authMethodCache) {
+        if (authMethod) {
+            [authMethodCache setObject:authMethod forKey:key];
+        } else {
+            [authMethodCache removeObjectForKey:key];
+        }
+    }
+}
+
+#pragma mark Requests
+
 - (void)submitRequest:(DLSFTPRequest *)request {
     request.connection = self;
     __weak DLSFTPConnection *weakSelf = self;
     dispatch_barrier_async(_requestQueue, ^{
-        [weakSelf.requests addObject:request];
+        if ([weakSelf waitForDependenciesOfRequest:request] == NO) {
+            [weakSelf.requests addRequest:request];
+        }
         [weakSelf cancelIdleTimer];
         [weakSelf startNextRequest];
     });
 }
 
+#pragma mark Dependencies
+
+// must be called on the request queue.  Returns YES if the request must wait
+// for its dependencies, or has failed because one of them failed or will never
+// run here: it was not submitted to this connection first, or was removed
+- (BOOL)waitForDependenciesOfRequest:(DLSFTPRequest *)request {
+    NSUInteger unfinishedCount = 0;
+    for (DLSFTPRequest *dependency in request.dependencies) {
+        if (dependency.isFinished == NO && dependency.connection != self) {
+            [self failDependentRequest:request];
+            return YES;
+        }
+        if (dependency.isFinished == NO) {
+            NSMutableArray *dependents = [self.dependents objectForKey:dependency];
+            if (dependents == nil) {
+                dependents = [[NSMutableArray alloc] init];
+                [self.dependents setObject:dependents forKey:dependency];
+            }
+            [dependents addObject:request];
+            unfinishedCount++;
+        } else if (dependency.error) {
+            [self failDependentRequest:request];
+            return YES;
+        }
+    }
+    if (unfinishedCount == 0) {
+        return NO;
+    }
+    [self.waitingRequests setObject:@(unfinishedCount) forKey:request];
+    return YES;
+}
+
+// must be called on the request queue, once request has finished.  Queues the
+// requests it was the last unfinished dependency of, or fails them all if it failed
+- (void)releaseDependentsOfRequest:(DLSFTPRequest *)request failed:(BOOL)failed {
+    NSArray *dependents = [self.dependents objectForKey:request];
+    if (dependents == nil) {
+        return;
+    }
+    [self.dependents removeObjectForKey:request];
+    for (DLSFTPRequest *dependent in dependents) {
+        NSNumber *unfinishedCount = [self.waitingRequests objectForKey:dependent];
+        if (unfinishedCount == nil) {
+            // already failed or removed
+            continue;
+        }
+        if (failed) {
+            [self.waitingRequests removeObjectForKey:dependent];
+            [self failDependentRequest:dependent];
+        } else if ([unfinishedCount unsignedIntegerValue] == 1) {
+            [self.waitingRequests removeObjectForKey:dependent];
+            [self.requests addRequest:dependent];
+        } else {
+            [self.waitingRequests setObject:@([unfinishedCount unsignedIntegerValue] - 1) forKey:dependent];
+        }
+    }
+}
+
+// must be called on the request queue.  Fails the request without starting
+// it, and with it everything depending on it
+- (void)failDependentRequest:(DLSFTPRequest *)request {
+    NSError *error = [request errorWithCode:eSFTPClientErrorDependencyFailed
+                           errorDescription:@"A request this request depends on failed or was not submitted"
+                            underlyingError:nil];
+    [self failUnstartedRequest:request withError:error];
+    [self releaseDependentsOfRequest:request failed:YES];
+}
+
+// must be called on the request queue, for a request that isn't running
+- (void)failUnstartedRequest:(DLSFTPRequest *)request withError:(NSError *)error {
+    request.error = error;
+    request.finished = YES;
+    // fail on the socket queue like other requests, as callbacks may be invoked inline
+    dispatch_async(self.socketQueue, ^{
+        [request fail];
+    });
+}
+
 - (void)removeRequest:(DLSFTPRequest *)request {
     __weak DLSFTPConnection *weakSelf = self;
     dispatch_barrier_async(_requestQueue, ^{
-        request.connection = nil;
-        if ([weakSelf.currentRequest isEqual:request]) {
-            [weakSelf.currentRequest cancel];
-            weakSelf.currentRequest = nil;
+        if ([weakSelf channelForRequest:request]) {
+            // the request keeps its connection and channel until it notices the
+            // cancellation and fails, which frees the channel for queued requests
+            [request cancel];
             return;
         }
-        [weakSelf.requests removeObject:request];
+        request.connection = nil;
+        [weakSelf.requests removeRequest:request];
+        [weakSelf.pendingRetries removeObject:request];
+        [weakSelf.waitingRequests removeObjectForKey:request];
+        // it will never run, so neither will anything depending on it
+        [weakSelf releaseDependentsOfRequest:request failed:YES];
         if ([weakSelf.requests count] == 0) {
             // start the idle timer
             [weakSelf startIdleTimer];
@@ -430,54 +863,160 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
     });
 }
 
-- (void)startNextRequest {
-    if (self.currentRequest) {
-        return;
+// must be called on the request queue
+- (DLSFTPChannel *)channelForRequest:(DLSFTPRequest *)request {
+    for (DLSFTPChannel *channel in self.channels) {
+        if ([channel.runningRequests containsObject:request]) {
+            return channel;
+        }
     }
+    return nil;
+}
+
+- (void)startNextRequest {
     __weak DLSFTPConnection *weakSelf = self;
     dispatch_barrier_async(_requestQueue, ^{
-        if (weakSelf.currentRequest) {
-            return;
+        [weakSelf startQueuedRequests];
+    });
+}
+
+// must be called on the request queue as a barrier
+- (void)startQueuedRequests {
+    BOOL idle = YES;
+    for (DLSFTPChannel *channel in self.channels) {
+        if (channel.needsRestart) {
+            idle = NO;
+            continue;
         }
-        if([weakSelf.requests count] > 0) {
-            DLSFTPRequest *request = [weakSelf.requests objectAtIndex:0];
-            [weakSelf.requests removeObjectAtIndex:0];
-            weakSelf.currentRequest = request;
-            [weakSelf startRequest];
-        } else {
-            // start the idle timer
-            [weakSelf startIdleTimer];
+        if ([channel isIdle] && [self.requests count] > 0) {
+            [self startRequest:[self.requests nextRequest] onChannel:channel];
         }
-    });
+    }
+    // rather than waiting for transfers to finish, higher priority requests run between their
+    // chunks, and further transfers interleave their chunks with them
+    for (DLSFTPChannel *channel in self.channels) {
+        while ([channel isPreemptible] && channel.needsRestart == NO) {
+            DLSFTPRequest *request = [self.requests nextRequestWithPriorityAbove:[channel priority]];
+            if (   request == nil
+                && [channel.runningRequests count] < self.transfersPerChannel
+                && [[self.requests peekRequest] isPreemptible]) {
+                request = [self.requests nextRequest];
+            }
+            if (request == nil) {
+                break;
+            }
+            [self startRequest:request onChannel:channel];
+        }
+        if ([channel isIdle] == NO) {
+            idle = NO;
+        }
+    }
+    if (idle && [self.pendingRetries count] == 0) {
+        // start the idle timer
+        [self startIdleTimer];
+    }
 }
 
-- (void)startRequest {
-    DLSFTPRequest *request = self.currentRequest;
+// must be called on the request queue as a barrier
+- (void)startRequest:(DLSFTPRequest *)request onChannel:(DLSFTPChannel *)channel {
+    [channel.runningRequests addObject:request];
     dispatch_group_notify(_connectionGroup, self.socketQueue, ^{
+        // sftp is only valid once connected, so assign it when starting
+        request.sftp = channel.sftp;
+        [request startTimeoutTimer];
         [request start];
     });
 }
 
 - (void)finishRequest:(DLSFTPRequest *)request failed:(BOOL)failed {
-    if (   self.currentRequest == nil
-        || [self.currentRequest isEqual:request] == NO) {
-        [NSException raise:SFTPClientCompleteRequestException
-                    format:@"Exception completing request %@, it is not the current request %@" , request, self.currentRequest];
+    [request stopTimeoutTimer];
+    if (request.batchRequest) {
+        // the batch, not the connection, is running it
+        [request.batchRequest request:request didFinishWithFailure:failed];
         return;
     }
+    __block DLSFTPChannel *channel = nil;
     __weak DLSFTPConnection *weakSelf = self;
+    dispatch_sync(_requestQueue, ^{
+        channel = [weakSelf channelForRequest:request];
+    });
+    if (channel == nil) {
+        [NSException raise:SFTPClientCompleteRequestException
+                    format:@"Exception completing request %@, it is not a current request" , request];
+        return;
+    }
+    dispatch_queue_t requestQueue = _requestQueue;
     dispatch_group_notify(_connectionGroup, self.socketQueue, ^{
-        if (failed) {
+        BOOL interrupted = [request isInterrupted];
+        BOOL retry = failed && [request shouldRetry];
+        NSTimeInterval delay = 0;
+        if (retry) {
+            delay = [request.retryPolicy delayAfterAttempt:request.retryCount + 1];
+            [request prepareForRetry];
+        } else if (failed) {
+            request.finished = YES;
             [request fail];
         } else {
+            request.finished = YES;
             [request succeed];
         }
-        weakSelf.currentRequest = nil;
+        dispatch_barrier_async(requestQueue, ^{
+            [channel.runningRequests removeObject:request];
+            if (interrupted) {
+                channel.needsRestart = YES;
+            }
+            [weakSelf restartChannelIfNeeded:channel];
+            if (retry) {
+                [weakSelf.pendingRetries addObject:request];
+                [weakSelf queueRetryOfRequest:request afterDelay:delay];
+            } else {
+                [weakSelf releaseDependentsOfRequest:request failed:failed];
+            }
+        });
         [weakSelf startNextRequest];
     });
 
 }
 
+// must be called on the request queue as a barrier.  Restarts the channel's
+// SFTP subsystem once the requests running on it have finished
+- (void)restartChannelIfNeeded:(DLSFTPChannel *)channel {
+    if (channel.needsRestart == NO || channel.restarting || [channel isIdle] == NO) {
+        return;
+    }
+    channel.restarting = YES;
+    __weak DLSFTPConnection *weakSelf = self;
+    dispatch_queue_t requestQueue = _requestQueue;
+    dispatch_group_notify(_connectionGroup, self.socketQueue, ^{
+        [weakSelf restartSftpOnChannel:channel];
+        dispatch_barrier_async(requestQueue, ^{
+            channel.restarting = NO;
+            channel.needsRestart = NO;
+            [weakSelf startQueuedRequests];
+        });
+    });
+}
+
+// must be called on the request queue.  The request goes back to the front
+// of its priority, as it was already at the front when it started
+- (void)queueRetryOfRequest:(DLSFTPRequest *)request afterDelay:(NSTimeInterval)delay {
+    __weak DLSFTPConnection *weakSelf = self;
+    dispatch_queue_t requestQueue = _requestQueue;
+    dispatch_time_t retryTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
+    dispatch_after(retryTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        dispatch_barrier_async(requestQueue, ^{
+            if ([weakSelf.pendingRetries containsObject:request] == NO) {
+                // removed while waiting
+                return;
+            }
+            [weakSelf.pendingRetries removeObject:request];
+            [weakSelf.requests addRequestToFront:request];
+            [weakSelf cancelIdleTimer];
+            [weakSelf startQueuedRequests];
+        });
+    });
+}
+
 - (void)requestDidFail:(DLSFTPRequest *)request withError:(NSError *)error {
     // error is also retained by the request, so is superfluous here
     [self finishRequest:request failed:YES];
@@ -505,9 +1044,9 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                                      userInfo:@{ NSLocalizedDescriptionKey : errorDescription }];
     if (self.connectionFailureBlock) {
         DLSFTPClientFailureBlock failureBlock = self.connectionFailureBlock;
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             failureBlock(error);
-        });
+        } toQueue:[self targetCallbackQueue]];
         [self clearConnectionBlocks];
     }
 }
@@ -516,12 +1055,24 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 
 - (void)cancelAllRequests {
     __weak DLSFTPConnection *weakSelf = self;
-    [self.currentRequest cancel];
     dispatch_barrier_sync(_requestQueue, ^{
-        for (DLSFTPRequest *request in weakSelf.requests) {
+        // running requests fail as they notice the cancellation
+        for (DLSFTPChannel *channel in weakSelf.channels) {
+            [channel.runningRequests makeObjectsPerformSelector:@selector(cancel)];
+        }
+        // the others are failed here, as they will never run
+        NSMutableArray *droppedRequests = [NSMutableArray arrayWithArray:[weakSelf.requests removeAllRequests]];
+        [droppedRequests addObjectsFromArray:[weakSelf.pendingRetries allObjects]];
+        for (DLSFTPRequest *request in [weakSelf.waitingRequests keyEnumerator]) {
+            [droppedRequests addObject:request];
+        }
+        [weakSelf.pendingRetries removeAllObjects];
+        [weakSelf.waitingRequests removeAllObjects];
+        [weakSelf.dependents removeAllObjects];
+        for (DLSFTPRequest *request in droppedRequests) {
             [request cancel];
+            [weakSelf failUnstartedRequest:request withError:[request cancellationError]];
         }
-        [weakSelf.requests removeAllObjects];
         [weakSelf startIdleTimer];
     });
 }
@@ -548,7 +1099,7 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                                              code:eSFTPClientErrorOperationInProgress
                                          userInfo:@{ NSLocalizedDescriptionKey : @"Connection in progress" }];
         if (failureBlock) {
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            dispatch_async([self targetCallbackQueue], ^{
                 failureBlock(error);
             });
         }
@@ -565,7 +1116,7 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                          errorDescription:@"Invalid username"];
         return;
 
-    } else if([self.password length] == 0 && [self.keypath length] == 0) {
+    } else if([self.password length] == 0 && [self.keypath length] == 0 && self.privateKey == nil) {
         [self failConnectionWithErrorCode:eSFTPClientErrorInvalidPasswordOrKey
                          errorDescription:@"Invalid password or key path"];
         return;
@@ -576,6 +1127,7 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
                          errorDescription:@"Already connected"];
         return;
     } else {
+        [self updateChannels];
         __weak DLSFTPConnection *weakSelf = self;
         // set up a timeout handler
         dispatch_source_t timeoutTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
@@ -795,6 +1347,7 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 
 - (void)disconnect {
     [self cancelAllRequests];
+    [self wakeup];
     // cancel the connection timeout timer if running
     if (self.timeoutTimer) {
         dispatch_source_cancel(self.timeoutTimer);
@@ -812,31 +1365,49 @@ static NSString * const SFTPClientCompleteRequestException = @"SFTPClientComplet
 
 // waitsocket from http://www.libssh2.org/examples/
 
+// also returns when the session's connection is woken, so that loops checking
+// for cancellation don't wait for the socket or the timeout
 int waitsocket(int socket_fd, LIBSSH2_SESSION *session) {
     struct timeval timeout;
     int rc;
-    fd_set fd;
+    fd_set readset;
+    fd_set writeset;
     fd_set *writefd = NULL;
-    fd_set *readfd = NULL;
     int dir;
+    int maxfd = socket_fd;
 
     timeout.tv_sec = 10;
     timeout.tv_usec = 0;
 
-    FD_ZERO(&fd);
-
-    FD_SET(socket_fd, &fd);
+    FD_ZERO(&readset);
+    FD_ZERO(&writeset);
 
     /* now make sure we wait in the correct direction */
     dir = libssh2_session_block_directions(session);
 
     if(dir & LIBSSH2_SESSION_BLOCK_INBOUND)
-        readfd = &fd;
+        FD_SET(socket_fd, &readset);
 
-    if(dir & LIBSSH2_SESSION_BLOCK_OUTBOUND)
-        writefd = &fd;
+    if(dir & LIBSSH2_SESSION_BLOCK_OUTBOUND) {
+        FD_SET(socket_fd, &writeset);
+        writefd = &writeset;
+    }
 
-    rc = select(socket_fd + 1, readfd, writefd, NULL, &timeout);
+    // unretained, as this is called while the connection deallocates
+    __unsafe_unretained DLSFTPConnection *connection = (__bridge DLSFTPConnection *)*libssh2_session_abstract(session);
+    int wakeup_fd = [connection wakeupFD];
+    if (wakeup_fd >= 0) {
+        FD_SET(wakeup_fd, &readset);
+        maxfd = MAX(maxfd, wakeup_fd);
+    }
+
+    rc = select(maxfd + 1, &readset, writefd, NULL, &timeout);
+
+    if (rc > 0 && wakeup_fd >= 0 && FD_ISSET(wakeup_fd, &readset)) {
+        // drain the pipe so the next wait blocks again
+        char buffer[64];
+        while (read(wakeup_fd, buffer, sizeof(buffer)) > 0);
+    }
 
     return rc;
 }
@@ -844,7 +1415,7 @@ int waitsocket(int socket_fd, LIBSSH2_SESSION *session) {
 // callback function for keyboard-interactive authentication
 LIBSSH2_USERAUTH_KBDINT_RESPONSE_FUNC(response) {
     DLSFTPConnection *connection = (__bridge DLSFTPConnection *)*abstract;
-    if (num_prompts > 0) {
+    if (num_prompts > 0 && connection.password) {
         // check if prompt is password
         // assume responses matches prompts
         // according to documentation, string values will be free'd
@@ -40,4 +40,52 @@
             successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
             failureBlock:(DLSFTPClientFailureBlock)failureBlock
            progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+// Downloads the file into memory instead of to a local file, for small files
+// that are only parsed.  The chunks read are joined without copying, and on
+// iOS 7 and later the data passed to successBlock is that dispatch_data_t.
+// Files larger than maximumLength bytes fail with eSFTPClientErrorFileTooLarge,
+// before reading if the server reports the size.  0 means no limit
+- (id)initWithRemotePath:(NSString *)remotePath
+           maximumLength:(unsigned long long)maximumLength
+            successBlock:(DLSFTPClientDataTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+@property (nonatomic, readonly) unsigned long long maximumLength;
+
+// Streams the file to dataBlock as it is read, instead of writing it to a
+// local file.  dataBlock is invoked with each chunk in order, one at a time, on
+// the callback queue, and successBlock once the last chunk has been consumed.
+// Reading pauses while more than maximumBytesInFlight is waiting for
+// dataBlock, so a slow consumer holds back the transfer rather than
+// buffering it.  Chunks already read when the request is cancelled or fails
+// are still delivered, before failureBlock, and a retry continues after them.
+// A dataBlock that blocks doesn't hold up a cancel or timeout: the channel is
+// released at once, and failureBlock follows when dataBlock returns
+- (id)initWithRemotePath:(NSString *)remotePath
+               dataBlock:(DLSFTPClientDataReceivedBlock)dataBlock
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+// Reserves local disk space for the rest of the remote file before reading
+// it, so the file is laid out contiguously where possible and a full disk
+// fails the request with eSFTPClientErrorInsufficientLocalSpace before
+// anything is transferred, leaving a file it would have replaced untouched.
+// Defaults to YES
+@property (nonatomic, assign) BOOL preallocatesLocalFile;
+// Received data is written to the local file in blocks of this many bytes,
+// aligned to multiples of it in the file, so the disk sees a few large
+// writes instead of one per network read.  Defaults to 1 MB, 0 writes each
+// read as it arrives
+@property (nonatomic, assign) size_t writeSize;
+// Bytes read from the server but not yet written to the local file, or
+// consumed by dataBlock.  Reading pauses when this is exceeded, until half of
+// it has been written, so a disk slower than the network doesn't buffer the
+// file in memory.  Defaults to 4 MB, 0 means no limit
+@property (nonatomic, assign) unsigned long long maximumBytesInFlight;
+// The most bytes waiting to be written at once, and the number of times
+// reading paused for the disk to catch up
+@property (nonatomic, readonly) unsigned long long peakBytesInFlight;
+@property (nonatomic, readonly) NSUInteger readPauseCount;
 @end
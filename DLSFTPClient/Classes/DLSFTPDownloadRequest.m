@@ -34,11 +34,21 @@
 #import "DLSFTPConnection.h"
 #import "DLSFTPFile.h"
 #import "NSDictionary+SFTPFileAttributes.h"
-
-//Constants
-static const size_t cBufferSize = 8192;
-
-@interface DLSFTPDownloadRequest ()
+#import "DLSFTPProgressReporter.h"
+#import "DLSFTPHasher.h"
+#import <libkern/OSAtomic.h>
+#import <sys/mount.h>
+
+static const unsigned long long cDefaultMaximumBytesInFlight = 4 * 1024 * 1024;
+static const size_t cDefaultWriteSize = 1024 * 1024;
+
+@interface DLSFTPDownloadRequest () {
+    // updated with atomic operations, by the socket queue and write handlers
+    volatile int64_t _bytesInFlight;
+    volatile int32_t _readingPaused;
+    // the first errno from writing or closing the local file
+    volatile int32_t _localWriteError;
+}
 
 @property (nonatomic, copy) DLSFTPClientProgressBlock progressBlock;
 @property (nonatomic, copy) NSString *remotePath;
@@ -47,20 +57,37 @@ static const size_t cBufferSize = 8192;
 @property (nonatomic, strong) NSDate *finishTime;
 @property (nonatomic, strong) DLSFTPFile *downloadedFile;
 @property (nonatomic) BOOL shouldResume;
+// YES if the local file didn't exist before this request
+@property (nonatomic) BOOL createdLocalFile;
 
 @property (nonatomic) dispatch_io_t channel;
-@property (nonatomic) dispatch_semaphore_t semaphore;
-@property (nonatomic) dispatch_source_t progressSource;
+@property (nonatomic) dispatch_group_t writeGroup; // left when the local file is closed
+@property (nonatomic) BOOL removesLocalFileOnClose;
+@property (nonatomic, strong) DLSFTPProgressReporter *progressReporter;
+@property (nonatomic, strong) DLSFTPHasher *hasher;
 
 @property (nonatomic, assign) LIBSSH2_SFTP_HANDLE *handle;
+@property (nonatomic, readwrite) unsigned long long peakBytesInFlight;
+@property (nonatomic, readwrite) NSUInteger readPauseCount;
+// received data not yet handed to the channel, and where it goes in the file
+@property (nonatomic) dispatch_data_t pendingData;
+@property (nonatomic, assign) unsigned long long writeOffset;
+// all data read, when downloading to memory
+@property (nonatomic) dispatch_data_t receivedData;
+@property (nonatomic, readwrite) unsigned long long maximumLength;
+// when streaming, the consumer and the serial queue chunks are delivered on
+@property (nonatomic, copy) DLSFTPClientDataReceivedBlock dataBlock;
+@property (nonatomic) dispatch_queue_t deliveryQueue;
 
 @end
 
 @implementation DLSFTPDownloadRequest
 
-@synthesize progressSource=_progressSource;
 @synthesize channel=_channel;
-@synthesize semaphore=_semaphore;
+@synthesize writeGroup=_writeGroup;
+@synthesize pendingData=_pendingData;
+@synthesize receivedData=_receivedData;
+@synthesize deliveryQueue=_deliveryQueue;
 
 - (id)initWithRemotePath:(NSString *)remotePath
                localPath:(NSString *)localPath
@@ -76,31 +103,86 @@ static const size_t cBufferSize = 8192;
         self.successBlock = successBlock;
         self.failureBlock = failureBlock;
         self.progressBlock = progressBlock;
+        self.maximumBytesInFlight = cDefaultMaximumBytesInFlight;
+        self.writeSize = cDefaultWriteSize;
+        self.preallocatesLocalFile = YES;
+    }
+    return self;
+}
+
+- (id)initWithRemotePath:(NSString *)remotePath
+           maximumLength:(unsigned long long)maximumLength
+            successBlock:(DLSFTPClientDataTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    self = [self initWithRemotePath:remotePath
+                          localPath:nil
+                             resume:NO
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+    if (self) {
+        self.maximumLength = maximumLength;
+    }
+    return self;
+}
+
+- (id)initWithRemotePath:(NSString *)remotePath
+               dataBlock:(DLSFTPClientDataReceivedBlock)dataBlock
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    self = [self initWithRemotePath:remotePath
+                          localPath:nil
+                             resume:NO
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+    if (self) {
+        self.dataBlock = dataBlock;
     }
     return self;
 }
 
 - (void)dealloc {
 #if NEEDS_DISPATCH_RETAIN_RELEASE
-    if (_progressSource) {
-        dispatch_release(_progressSource);
-        _progressSource = NULL;
-    }
-    if (_semaphore) {
-        dispatch_release(_semaphore);
-        _semaphore = NULL;
+    if (_writeGroup) {
+        dispatch_release(_writeGroup);
+        _writeGroup = NULL;
     }
     if (_channel) {
         dispatch_release(_channel);
         _channel = NULL;
     }
+    if (_pendingData) {
+        dispatch_release(_pendingData);
+        _pendingData = NULL;
+    }
+    if (_receivedData) {
+        dispatch_release(_receivedData);
+        _receivedData = NULL;
+    }
+    if (_deliveryQueue) {
+        dispatch_release(_deliveryQueue);
+        _deliveryQueue = NULL;
+    }
 #endif
 }
 
 
+- (BOOL)isPreemptible {
+    return YES;
+}
+
+- (void)prepareForRetry {
+    [super prepareForRetry];
+    // continue from the data already downloaded
+    self.shouldResume = YES;
+}
+
 - (BOOL)openFileHandle {
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
     LIBSSH2_SFTP_HANDLE *handle = NULL;
     while (   (handle = libssh2_sftp_open(sftp, [self.remotePath UTF8String], LIBSSH2_FXF_READ, 0)) == NULL
@@ -111,7 +193,7 @@ static const size_t cBufferSize = 8192;
     self.handle = handle;
     if (handle == NULL) {
         // unable to open
-        unsigned long lastError = libssh2_sftp_last_error([self.connection sftp]);
+        unsigned long lastError = libssh2_sftp_last_error(self.sftp);
         NSString *errorDescription = [NSString stringWithFormat:@"Unable to open file for reading: SFTP Status Code %ld", lastError];
         self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenFile
                         errorDescription:errorDescription
@@ -122,20 +204,14 @@ static const size_t cBufferSize = 8192;
     }
 }
 
-- (void)start {
-    if (   [self pathIsValid:self.localPath] == NO
-        || [self pathIsValid:self.remotePath] == NO
-        || [self ready] == NO
-        || [self checkSftp] == NO) {
-        [self.connection requestDidFail:self withError:self.error];
-        return;
-    }
-    unsigned long long resumeOffset = 0ull;
+// Creates the local file if needed, and finds the offset to resume from
+- (BOOL)prepareLocalFile:(unsigned long long *)resumeOffset {
+    self.createdLocalFile = NO;
     if ([[NSFileManager defaultManager] fileExistsAtPath:self.localPath] == NO) {
         // File does not exist, create it
-        [[NSFileManager defaultManager] createFileAtPath:self.localPath
-                                                contents:nil
-                                              attributes:nil];
+        self.createdLocalFile = [[NSFileManager defaultManager] createFileAtPath:self.localPath
+                                                                        contents:nil
+                                                                      attributes:nil];
     } else {
         // local file exists, get existing size
         NSError *error = nil;
@@ -145,12 +221,11 @@ static const size_t cBufferSize = 8192;
             self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForWriting
                             errorDescription:@"Unable to get attributes (file size) of existing file"
                              underlyingError:@(error.code)];
-            [self.connection requestDidFail:self withError:self.error];
-            return;
+            return NO;
         }
 
         if(self.shouldResume) {
-            resumeOffset = [localAttributes fileSize];
+            *resumeOffset = [localAttributes fileSize];
         }
     }
 
@@ -158,9 +233,183 @@ static const size_t cBufferSize = 8192;
         self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForWriting
                         errorDescription:@"Local file is not writable"
                          underlyingError:nil];
+        return NO;
+    }
+    return YES;
+}
+
+// Opens the local file at resumeOffset and the channel writing to it
+- (BOOL)openLocalFileWithAttributes:(LIBSSH2_SFTP_ATTRIBUTES *)attributes
+                       resumeOffset:(unsigned long long)resumeOffset {
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    if (self.writeGroup) {
+        dispatch_release(self.writeGroup);
+    }
+#endif
+    dispatch_group_t writeGroup = dispatch_group_create();
+    dispatch_group_enter(writeGroup);
+    self.writeGroup = writeGroup;
+    self.removesLocalFileOnClose = NO;
+    _localWriteError = 0;
+
+    int oflag;
+    if (self.shouldResume) {
+        oflag =   O_APPEND
+        | O_WRONLY
+        | O_CREAT;
+    } else {
+        // truncated below, once the download is known to fit
+        oflag =   O_WRONLY
+        | O_CREAT;
+    }
+    // opened here rather than by the channel, so space can be reserved after truncating
+    int fd = open([self.localPath fileSystemRepresentation], oflag, 0644);
+    if (fd < 0) {
+        int openError = errno;
+        dispatch_group_leave(writeGroup);
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to open %@ for writing: %s", self.localPath, strerror(openError)];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForWriting
+                        errorDescription:errorDescription
+                         underlyingError:@(openError)];
+        return NO;
+    }
+    off_t reserveLength = 0;
+    if (   self.preallocatesLocalFile
+        && (attributes->flags & LIBSSH2_SFTP_ATTR_SIZE)
+        && attributes->filesize > resumeOffset) {
+        reserveLength = (off_t)(attributes->filesize - resumeOffset);
+    }
+    // a file being replaced is kept if the download won't fit
+    BOOL prepared = YES;
+    if (self.shouldResume == NO) {
+        prepared = [self file:fd hasSpaceForLength:reserveLength] && [self truncateFile:fd];
+    }
+    if (prepared && reserveLength > 0) {
+        prepared = [self preallocateFile:fd length:reserveLength];
+    }
+    if (prepared == NO) {
+        close(fd);
+        if (self.createdLocalFile) {
+            [[NSFileManager defaultManager] removeItemAtPath:self.localPath error:nil];
+        }
+        dispatch_group_leave(writeGroup);
+        return NO;
+    }
+
+    /* Begin dispatch io */
+    // called once all writes are flushed and the file is closed, off the socket queue
+    void(^cleanup_handler)(int) = ^(int error) {
+        if (error) {
+            [self noteLocalWriteError:error];
+        }
+        if (close(fd) != 0) {
+            [self noteLocalWriteError:errno];
+        }
+        if (self.removesLocalFileOnClose) {
+            NSError __autoreleasing *deleteError = nil;
+            if([[NSFileManager defaultManager] removeItemAtPath:self.localPath error:&deleteError] == NO) {
+                NSLog(@"Unable to delete unfinished file: %@", deleteError);
+            }
+        }
+        dispatch_group_leave(writeGroup);
+    };
+
+    dispatch_io_t channel = dispatch_io_create(  DISPATCH_IO_STREAM
+                                               , fd
+                                               , dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,  0   )
+                                               , cleanup_handler
+                                               );
+    if (channel == NULL) {
+        // Error creating the channel, so the cleanup handler won't be called
+        close(fd);
+        dispatch_group_leave(writeGroup);
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to create a channel for writing to %@", self.localPath];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToCreateChannel
+                        errorDescription:errorDescription
+                         underlyingError:nil];
+        return NO;
+    } else {
+        self.channel = channel;
+    }
+    /* dispatch_io has been created */
+    return YES;
+}
+
+// Starts the hash, over the data already received when resuming, so the
+// digest covers the whole file.  A resumed local file is read back once, here
+- (BOOL)prepareHasherFromOffset:(unsigned long long)resumeOffset {
+    if (self.hashAlgorithm == eSFTPClientHashAlgorithmNone) {
+        self.hasher = nil;
+        return YES;
+    }
+    if (self.dataBlock && resumeOffset > 0 && self.hasher) {
+        // a retried stream, the hasher has seen every chunk delivered
+        return YES;
+    }
+    DLSFTPHasher *hasher = [[DLSFTPHasher alloc] initWithAlgorithm:self.hashAlgorithm];
+    BOOL hashed = (hasher != nil);
+    if (hashed && resumeOffset > 0) {
+        if (self.localPath) {
+            hashed = [hasher updateWithContentsOfFile:self.localPath length:resumeOffset];
+        } else if (self.receivedData) {
+            [hasher updateWithData:self.receivedData];
+        } else {
+            hashed = NO;
+        }
+    }
+    if (hashed == NO) {
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
+                        errorDescription:@"Unable to hash the data already downloaded"
+                         underlyingError:nil];
+        return NO;
+    }
+    self.hasher = hasher;
+    return YES;
+}
+
+- (void)start {
+    if (self.writeGroup && dispatch_group_wait(self.writeGroup, DISPATCH_TIME_NOW) != 0) {
+        // a previous attempt is still writing the local file this one may resume
+        __weak DLSFTPDownloadRequest *weakSelf = self;
+        dispatch_group_notify(self.writeGroup, self.connection.socketQueue, ^{
+            [weakSelf start];
+        });
+        return;
+    }
+    if (   [self pathIsValid:self.remotePath] == NO
+        || [self ready] == NO
+        || [self checkSftp] == NO) {
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
+    unsigned long long resumeOffset = 0ull;
+    if (self.localPath) {
+        if (   [self pathIsValid:self.localPath] == NO
+            || [self prepareLocalFile:&resumeOffset] == NO) {
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+    } else if (self.dataBlock) {
+        if (self.shouldResume) {
+            // a retry continues after the data already delivered
+            resumeOffset = self.writeOffset;
+        }
+        if (self.deliveryQueue == NULL) {
+            dispatch_queue_t deliveryQueue = dispatch_queue_create("com.hammockdistrict.SFTPClient.delivery", DISPATCH_QUEUE_SERIAL);
+            dispatch_set_target_queue(deliveryQueue, [self targetCallbackQueue]);
+            self.deliveryQueue = deliveryQueue;
+        }
+    } else if (self.shouldResume && self.receivedData) {
+        // a retry continues after the data already received
+        resumeOffset = dispatch_data_get_size(self.receivedData);
+    } else {
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        if (self.receivedData) {
+            dispatch_release(self.receivedData);
+        }
+#endif
+        self.receivedData = dispatch_data_empty;
+    }
 
     LIBSSH2_SESSION *session = [self.connection session];
     int socketFD = [self.connection socket];
@@ -198,71 +447,33 @@ static const size_t cBufferSize = 8192;
     if (self.shouldResume) {
         libssh2_sftp_seek64(self.handle, resumeOffset);
     }
-
-    self.semaphore = dispatch_semaphore_create(0);
-
-    /* Begin dispatch io */
-    void(^cleanup_handler)(int) = ^(int error) {
-        if (error) {
-            printf("Error creating channel: %d", error);
-        }
-        dispatch_semaphore_signal(self.semaphore);
-    };
-
-    int oflag;
-    if (self.shouldResume) {
-        oflag =   O_APPEND
-        | O_WRONLY
-        | O_CREAT;
-    } else {
-        oflag =   O_WRONLY
-        | O_CREAT
-        | O_TRUNC;
+    self.writeOffset = resumeOffset;
+    if ([self prepareHasherFromOffset:resumeOffset] == NO) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
     }
 
-    dispatch_io_t channel = dispatch_io_create_with_path(  DISPATCH_IO_STREAM
-                                                         , [self.localPath UTF8String]
-                                                         , oflag
-                                                         , 0
-                                                         , dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,  0   )
-                                                         , cleanup_handler
-                                                         );
-    if (channel == NULL) {
-        // Error creating the channel
-        NSString *errorDescription = [NSString stringWithFormat:@"Unable to create a channel for writing to %@", self.localPath];
-        self.error = [self errorWithCode:eSFTPClientErrorUnableToCreateChannel
-                        errorDescription:errorDescription
-                         underlyingError:nil];
+    if (self.localPath) {
+        if ([self openLocalFileWithAttributes:&attributes resumeOffset:resumeOffset] == NO) {
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+    } else if (   (attributes.flags & LIBSSH2_SFTP_ATTR_SIZE)
+               && [self exceedsMaximumLength:attributes.filesize]) {
+        self.error = [self fileTooLargeError:attributes.filesize];
         [self.connection requestDidFail:self withError:self.error];
         return;
-    } else {
-        self.channel = channel;
     }
-    /* dispatch_io has been created */
 
-    // configure progress source
-    dispatch_source_t progressSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
-    __block unsigned long long bytesReceived = resumeOffset;
-    unsigned long long filesize = attributes.filesize;
-    DLSFTPClientProgressBlock progressBlock = self.progressBlock;
-    dispatch_source_set_event_handler(progressSource, ^{
-        bytesReceived += dispatch_source_get_data(progressSource);
-        if (progressBlock) {
-            progressBlock(bytesReceived, filesize);
-        }
-    });
-    self.progressSource = progressSource;
+    // configure progress reporting
+    self.progressReporter = [[DLSFTPProgressReporter alloc] initWithQueue:[self targetCallbackQueue]
+                                                               bytesTotal:attributes.filesize
+                                                             initialBytes:resumeOffset
+                                                                 interval:self.progressInterval
+                                                              granularity:self.progressGranularity
+                                                            progressBlock:self.progressBlock
+                                                    transferProgressBlock:self.transferProgressBlock];
     __weak DLSFTPDownloadRequest *weakSelf = self;
-    dispatch_source_set_cancel_handler(progressSource, ^{
-    #if NEEDS_DISPATCH_RETAIN_RELEASE
-        if (weakSelf.progressSource) {
-            dispatch_release(weakSelf.progressSource);
-            weakSelf.progressSource = NULL;
-        }
-    #endif
-    });
-    dispatch_resume(self.progressSource);
-     // end of progressSource setup
 
     self.startTime = [NSDate date];
     // start the first download block
@@ -270,35 +481,50 @@ static const size_t cBufferSize = 8192;
 }
 
 - (void)downloadChunk {
-    size_t bytesRead = 0;
-    char *buffer = malloc(sizeof(char) * cBufferSize);
+    if (_localWriteError) {
+        // the file can't be completed, so stop reading
+        self.error = [self localWriteError];
+        [self downloadFailed];
+        return;
+    }
+    ssize_t bytesRead = 0;
+    size_t bufferSize = self.connection.transferBufferSize;
+    char *buffer = malloc(sizeof(char) * bufferSize);
     while (   self.isCancelled == NO
-           && (bytesRead = libssh2_sftp_read(self.handle, buffer, cBufferSize)) == LIBSSH2SFTP_EAGAIN) {
+           && (bytesRead = libssh2_sftp_read(self.handle, buffer, bufferSize)) == LIBSSH2SFTP_EAGAIN) {
         waitsocket([self.connection socket], [self.connection session]);
     }
+    [self.connection adjustReceiveWindowOfSftp:self.sftp];
     // after data has been read, write it to the channel
     __weak DLSFTPDownloadRequest *weakSelf = self;
     if (bytesRead > 0) {
+        [self noteActivity];
+        BOOL tooLarge = NO;
         @autoreleasepool {
-            dispatch_source_merge_data(self.progressSource, bytesRead);
+            [self.progressReporter addBytes:bytesRead];
+            [self.hasher updateWithBytes:buffer length:bytesRead];
             dispatch_data_t data = dispatch_data_create(buffer, bytesRead, NULL, DISPATCH_DATA_DESTRUCTOR_FREE);
-            dispatch_io_write(  self.channel
-                              , 0
-                              , data
-                              , dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)
-                              , ^(bool done, dispatch_data_t data, int error) {
-                                  // done refers to the chunk of data written
-                                  // Tried moving progress reporting here, didn't make much difference
-                                  if (error) {
-                                      printf("error in dispatch_io_write %d\n", error);
-                                  }
-                              });
+            if (self.localPath == nil && self.dataBlock == nil) {
+                tooLarge = ([self appendReceivedData:data] == NO);
+            } else {
+                unsigned long long bytesInFlight = OSAtomicAdd64Barrier(bytesRead, &_bytesInFlight);
+                self.peakBytesInFlight = MAX(self.peakBytesInFlight, bytesInFlight);
+                if (self.localPath) {
+                    [self appendPendingData:data];
+                } else {
+                    [self deliverData:data];
+                }
+            }
 #if NEEDS_DISPATCH_RETAIN_RELEASE
             dispatch_release(data);
 #endif
         }
-        // read the next chunk
-        dispatch_async(self.connection.socketQueue, ^{ [weakSelf downloadChunk]; });
+        if (tooLarge) {
+            dispatch_async(self.connection.socketQueue, ^{ [weakSelf downloadFailed]; });
+        } else if ([self pauseReadingForWrites] == NO) {
+            // read the next chunk, unless too much is waiting to be written
+            dispatch_async(self.connection.socketQueue, ^{ [weakSelf downloadChunk]; });
+        }
     } else if(bytesRead == 0 || self.isCancelled) { // not a host error if cancelled
         free(buffer);
         dispatch_async(self.connection.socketQueue, ^{ [weakSelf downloadFinished]; });
@@ -308,19 +534,258 @@ static const size_t cBufferSize = 8192;
     }
 }
 
+// called on the socket queue with each chunk read when streaming.  The
+// consumer's progress is tracked as writes are, so it can pause reading
+- (void)deliverData:(dispatch_data_t)data {
+    DLSFTPClientDataReceivedBlock dataBlock = self.dataBlock;
+    size_t length = dispatch_data_get_size(data);
+    self.writeOffset += length;
+    __weak DLSFTPDownloadRequest *weakSelf = self;
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_retain(data);
+#endif
+    dispatch_async(self.deliveryQueue, ^{
+        if (dataBlock) {
+            dataBlock(data);
+        }
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(data);
+#endif
+        [weakSelf didWriteBytes:length];
+    });
+}
+
+- (NSError *)fileTooLargeError:(unsigned long long)length {
+    NSString *errorDescription = [NSString stringWithFormat:@"%@ is %llu bytes, more than the %llu allowed", self.remotePath, length, self.maximumLength];
+    return [self errorWithCode:eSFTPClientErrorFileTooLarge
+              errorDescription:errorDescription
+               underlyingError:nil];
+}
+
+// a maximumLength of 0 means no limit, as it is when streaming
+- (BOOL)exceedsMaximumLength:(unsigned long long)length {
+    return self.maximumLength > 0 && length > self.maximumLength;
+}
+
+// called on the socket queue with each chunk read into memory.  Returns NO
+// and sets error once more than maximumLength has been read
+- (BOOL)appendReceivedData:(dispatch_data_t)data {
+    dispatch_data_t receivedData = dispatch_data_create_concat(self.receivedData, data);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(self.receivedData);
+#endif
+    self.receivedData = receivedData;
+    size_t length = dispatch_data_get_size(receivedData);
+    if ([self exceedsMaximumLength:length]) {
+        self.error = [self fileTooLargeError:length];
+        return NO;
+    }
+    return YES;
+}
+
+// Reserves length bytes past the end of fd without changing its size, so
+// appends and resuming by file size are unaffected.  Returns NO and sets
+// error only if the disk is full, filesystems that can't preallocate are
+// written to as before
+- (BOOL)preallocateFile:(int)fd length:(off_t)length {
+    // prefer a contiguous allocation, but take what's free
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, length, 0 };
+    int result = fcntl(fd, F_PREALLOCATE, &store);
+    if (result == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        result = fcntl(fd, F_PREALLOCATE, &store);
+    }
+    if (result == -1 && errno == ENOSPC) {
+        self.error = [self insufficientLocalSpaceError:length];
+        return NO;
+    }
+    return YES;
+}
+
+- (NSError *)insufficientLocalSpaceError:(off_t)length {
+    NSString *errorDescription = [NSString stringWithFormat:@"Not enough space to download %llu bytes to %@", (unsigned long long)length, self.localPath];
+    return [self errorWithCode:eSFTPClientErrorInsufficientLocalSpace
+              errorDescription:errorDescription
+               underlyingError:@(ENOSPC)];
+}
+
+// Returns NO and sets error if the free space, plus what truncating fd would
+// free, is less than length.  YES if the space can't be determined
+- (BOOL)file:(int)fd hasSpaceForLength:(off_t)length {
+    struct stat fileStat;
+    struct statfs fileSystemStat;
+    if (length == 0 || fstat(fd, &fileStat) != 0 || fstatfs(fd, &fileSystemStat) != 0) {
+        return YES;
+    }
+    unsigned long long available =   (unsigned long long)fileSystemStat.f_bavail * fileSystemStat.f_bsize
+                                   + (unsigned long long)fileStat.st_blocks * 512;
+    if ((unsigned long long)length > available) {
+        self.error = [self insufficientLocalSpaceError:length];
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)truncateFile:(int)fd {
+    if (ftruncate(fd, 0) != 0) {
+        int truncateError = errno;
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to truncate %@: %s", self.localPath, strerror(truncateError)];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForWriting
+                        errorDescription:errorDescription
+                         underlyingError:@(truncateError)];
+        return NO;
+    }
+    return YES;
+}
+
+// called on the socket queue with each chunk read.  Writes out the pending
+// data up to the last writeSize boundary of the file it reaches, if any
+- (void)appendPendingData:(dispatch_data_t)data {
+    if (self.pendingData) {
+        dispatch_data_t pendingData = dispatch_data_create_concat(self.pendingData, data);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(self.pendingData);
+#endif
+        self.pendingData = pendingData;
+    } else {
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_retain(data);
+#endif
+        self.pendingData = data;
+    }
+    unsigned long long writeSize = self.writeSize;
+    unsigned long long pendingEnd = self.writeOffset + dispatch_data_get_size(self.pendingData);
+    if (writeSize == 0) {
+        [self writeAllPendingData];
+    } else if (pendingEnd / writeSize > self.writeOffset / writeSize) {
+        [self writePendingData:(size_t)((pendingEnd / writeSize) * writeSize - self.writeOffset)];
+    }
+}
+
+// hands the first length bytes of the pending data to the channel
+- (void)writePendingData:(size_t)length {
+    dispatch_data_t pendingData = self.pendingData;
+    if (length == 0 || pendingData == NULL) {
+        return;
+    }
+    size_t pendingSize = dispatch_data_get_size(pendingData);
+    dispatch_data_t data = pendingData;
+    if (length < pendingSize) {
+        // subranges share the received buffers rather than copying them
+        data = dispatch_data_create_subrange(pendingData, 0, length);
+        self.pendingData = dispatch_data_create_subrange(pendingData, length, pendingSize - length);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(pendingData);
+#endif
+    } else {
+        self.pendingData = NULL;
+    }
+    self.writeOffset += length;
+    __weak DLSFTPDownloadRequest *weakSelf = self;
+    dispatch_io_write(  self.channel
+                      , 0
+                      , data
+                      , dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)
+                      , ^(bool done, dispatch_data_t data, int error) {
+                          // done refers to the chunk of data written
+                          if (error) {
+                              [weakSelf noteLocalWriteError:error];
+                          }
+                          if (done) {
+                              [weakSelf didWriteBytes:length];
+                          }
+                      });
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(data);
+#endif
+}
+
+// called off the socket queue by the channel's handlers
+- (void)noteLocalWriteError:(int)error {
+    OSAtomicCompareAndSwap32Barrier(0, error, &_localWriteError);
+}
+
+- (NSError *)localWriteError {
+    int error = _localWriteError;
+    NSString *errorDescription = [NSString stringWithFormat:@"Unable to write to %@: %s", self.localPath, strerror(error)];
+    return [self errorWithCode:(error == ENOSPC ? eSFTPClientErrorInsufficientLocalSpace : eSFTPClientErrorUnableToWriteFile)
+              errorDescription:errorDescription
+               underlyingError:@(error)];
+}
+
+- (void)writeAllPendingData {
+    if (self.pendingData) {
+        [self writePendingData:dispatch_data_get_size(self.pendingData)];
+    }
+}
+
+// reading resumes once this much is waiting to be written
+- (unsigned long long)resumeReadingThreshold {
+    return self.maximumBytesInFlight / 2;
+}
+
+// called on the socket queue after a chunk is handed to the channel.  Returns
+// YES if reading is paused, to be resumed by didWriteBytes: or didCancel
+- (BOOL)pauseReadingForWrites {
+    if (self.maximumBytesInFlight == 0 || (unsigned long long)_bytesInFlight <= self.maximumBytesInFlight) {
+        return NO;
+    }
+    // only writes in progress can resume reading
+    [self writeAllPendingData];
+    OSAtomicCompareAndSwap32Barrier(0, 1, &_readingPaused);
+    // writes may have finished, or the request been cancelled, before the flag
+    // was set, and won't resume reading
+    if (   (   (unsigned long long)OSAtomicAdd64Barrier(0, &_bytesInFlight) <= [self resumeReadingThreshold]
+            || self.isCancelled)
+        && OSAtomicCompareAndSwap32Barrier(1, 0, &_readingPaused)) {
+        return NO;
+    }
+    self.readPauseCount += 1;
+    return YES;
+}
+
+// called by write handlers, off the socket queue
+- (void)didWriteBytes:(unsigned long long)bytes {
+    [self noteActivity];
+    int64_t bytesInFlight = OSAtomicAdd64Barrier(-(int64_t)bytes, &_bytesInFlight);
+    if (   (unsigned long long)bytesInFlight <= [self resumeReadingThreshold]
+        && OSAtomicCompareAndSwap32Barrier(1, 0, &_readingPaused)) {
+        dispatch_queue_t socketQueue = self.connection.socketQueue;
+        if (socketQueue) {
+            __weak DLSFTPDownloadRequest *weakSelf = self;
+            dispatch_async(socketQueue, ^{ [weakSelf downloadChunk]; });
+        }
+    }
+}
+
+// A stalled write or a blocked dataBlock would otherwise keep reading paused,
+// and the request on its channel, after a cancel or timeout.  Reading resumes
+// to notice the cancellation and finish the request
+- (void)didCancel {
+    if (OSAtomicCompareAndSwap32Barrier(1, 0, &_readingPaused)) {
+        dispatch_queue_t socketQueue = self.connection.socketQueue;
+        if (socketQueue) {
+            __weak DLSFTPDownloadRequest *weakSelf = self;
+            dispatch_async(socketQueue, ^{ [weakSelf downloadChunk]; });
+        }
+    }
+}
+
 - (void)downloadFinished {
     // nothing read, done
     self.finishTime = [NSDate date];
-    dispatch_source_cancel(self.progressSource);
-    dispatch_io_close(self.channel, 0);
+    [self.progressReporter finish];
+    [self writeAllPendingData];
+    // delete the file if cancelled and not resumable, once pending writes are done
+    self.removesLocalFileOnClose = self.isCancelled && self.shouldResume == NO;
+    // the local file is flushed and closed in the background, while the remote
+    // handle is closed and the connection moves on.  Blocks wait for writeGroup
+    if (self.channel) {
+        dispatch_io_close(self.channel, 0);
+    }
 
     /* End dispatch_io */
 
-    dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-#if NEEDS_DISPATCH_RETAIN_RELEASE
-    dispatch_release(self.semaphore);
-    self.semaphore = NULL;
-#endif
     int socketFD = [self.connection socket];
     LIBSSH2_SESSION *session = [self.connection session];
     // now close the remote handle
@@ -347,39 +812,52 @@ static const size_t cBufferSize = 8192;
             }
             self.handle = NULL;
         }
-
-        // delete the file if not resumable
-        if (self.shouldResume == NO) {
-            NSError __autoreleasing *deleteError = nil;
-            if([[NSFileManager defaultManager] removeItemAtPath:self.localPath error:&deleteError] == NO) {
-                NSLog(@"Unable to delete unfinished file: %@", deleteError);
-            }
-        }
-        self.error = [self errorWithCode:eSFTPClientErrorCancelledByUser
-                        errorDescription:@"Cancelled by user."
-                         underlyingError:nil];
+        self.error = [self cancellationError];
         [self.connection requestDidFail:self withError:self.error];
         return;
     } else {
-        [self.connection requestDidComplete:self];
+        if (self.hasher) {
+            self.downloadedFile = [[DLSFTPFile alloc] initWithPath:self.downloadedFile.path
+                                                        attributes:self.downloadedFile.attributes
+                                                            digest:[self.hasher finish]];
+            self.hasher = nil;
+        }
+        if (self.writeGroup == NULL) {
+            [self.connection requestDidComplete:self];
+            return;
+        }
+        // only complete once every write has succeeded
+        __weak DLSFTPDownloadRequest *weakSelf = self;
+        dispatch_group_notify(self.writeGroup, self.connection.socketQueue, ^{
+            [weakSelf localFileClosed];
+        });
     }
 }
 
+// called on the socket queue once the local file is flushed and closed
+- (void)localFileClosed {
+    if (_localWriteError) {
+        self.error = [self localWriteError];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    [self.connection requestDidComplete:self];
+}
+
 - (void)downloadFailed {
     // nothing read, done
     self.finishTime = [NSDate date];
-    dispatch_source_cancel(self.progressSource);
-    dispatch_io_close(self.channel, 0);
+    [self.progressReporter finish];
+    // keep what was received, so the download can be resumed
+    [self writeAllPendingData];
+    if (self.channel) {
+        dispatch_io_close(self.channel, 0);
+    }
 
     /* End dispatch_io */
 
-    dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-#if NEEDS_DISPATCH_RETAIN_RELEASE
-    dispatch_release(self.semaphore);
-    self.semaphore = NULL;
-#endif
     // get the error before closing the file
-    unsigned long result = libssh2_sftp_last_error([self.connection sftp]);
+    unsigned long result = libssh2_sftp_last_error(self.sftp);
     int socketFD = [self.connection socket];
     LIBSSH2_SESSION *session = [self.connection session];
     if (self.handle) {
@@ -388,6 +866,11 @@ static const size_t cBufferSize = 8192;
         }
         self.handle = NULL;
     }
+    if (self.error) {
+        // reading was stopped, not a host error
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
     // error reading
     NSString *errorDescription = [NSString stringWithFormat:@"Read file failed with code %lu.", result];
     self.error = [self errorWithCode:eSFTPClientErrorUnableToReadFile
@@ -396,13 +879,68 @@ static const size_t cBufferSize = 8192;
     [self.connection requestDidFail:self withError:self.error];
 }
 
+// releases the data read into memory, as NSData
+- (NSData *)takeReceivedData {
+    dispatch_data_t receivedData = self.receivedData;
+    if (receivedData == NULL) {
+        return nil;
+    }
+    self.receivedData = NULL;
+#if DISPATCH_DATA_IS_NSDATA
+    NSData *data = (NSData *)receivedData;
+#else
+    // dispatch_data_t isn't NSData before iOS 7, so the chunks are copied once
+    NSMutableData *data = [NSMutableData dataWithCapacity:dispatch_data_get_size(receivedData)];
+    dispatch_data_apply(receivedData, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        [data appendBytes:buffer length:size];
+        return true;
+    });
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(receivedData);
+#endif
+#endif
+    return data;
+}
+
 - (void)succeed {
+    if (self.dataBlock) {
+        DLSFTPClientFileTransferSuccessBlock successBlock = self.successBlock;
+        DLSFTPFile *downloadedFile = self.downloadedFile;
+        NSDate *startTime = self.startTime;
+        NSDate *finishTime = self.finishTime;
+        if (successBlock) {
+            // after the last chunk has been consumed
+            dispatch_async(self.deliveryQueue, ^{
+                successBlock(downloadedFile,startTime,finishTime);
+            });
+        }
+        self.successBlock = nil;
+        self.failureBlock = nil;
+        self.dataBlock = nil;
+        return;
+    }
+    if (self.localPath == nil) {
+        DLSFTPClientDataTransferSuccessBlock successBlock = self.successBlock;
+        DLSFTPFile *downloadedFile = self.downloadedFile;
+        NSDate *startTime = self.startTime;
+        NSDate *finishTime = self.finishTime;
+        NSData *data = [self takeReceivedData];
+        if (successBlock) {
+            [self dispatchCallback:^{
+                successBlock(downloadedFile, startTime, finishTime, data);
+            }];
+        }
+        self.successBlock = nil;
+        self.failureBlock = nil;
+        return;
+    }
     DLSFTPClientFileTransferSuccessBlock successBlock = self.successBlock;
     DLSFTPFile *downloadedFile = self.downloadedFile;
     NSDate *startTime = self.startTime;
     NSDate *finishTime = self.finishTime;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        // downloadFinished waited for the writes, so this is immediate
+        dispatch_group_notify(self.writeGroup, [self targetCallbackQueue], ^{
             successBlock(downloadedFile,startTime,finishTime);
         });
     }
@@ -410,4 +948,28 @@ static const size_t cBufferSize = 8192;
     self.failureBlock = nil;
 }
 
+- (void)fail {
+    [self takeReceivedData];
+    self.dataBlock = nil;
+    if (self.deliveryQueue) {
+        // after the chunks already delivered
+        dispatch_async(self.deliveryQueue, ^{
+            [super fail];
+        });
+        return;
+    }
+    if (self.writeGroup == NULL) {
+        [super fail];
+        return;
+    }
+    // report the failure once the local file is closed, so it can be resumed
+    dispatch_queue_t queue = self.connection.socketQueue;
+    if (queue == NULL) {
+        queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    }
+    dispatch_group_notify(self.writeGroup, queue, ^{
+        [super fail];
+    });
+}
+
 @end
@@ -35,8 +35,15 @@
 - (id)initWithPath:(NSString *)path
         attributes:(NSDictionary *)attributes;
 
+- (id)initWithPath:(NSString *)path
+        attributes:(NSDictionary *)attributes
+            digest:(NSData *)digest;
+
 @property (strong, nonatomic, readonly) NSString *path;
 @property (strong, nonatomic, readonly) NSDictionary *attributes;
+// The hash of the file's content computed by the transfer that produced this
+// object, if it was given a hashAlgorithm, otherwise nil
+@property (strong, nonatomic, readonly) NSData *digest;
 
 - (NSString *)filename;
 
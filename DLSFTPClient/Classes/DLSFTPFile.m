@@ -31,6 +31,7 @@
 
 NSString * const DLSFTPFilePathKey = @"DLSFTPFilePath";
 NSString * const DLSFTPFileAttributesKey = @"DLSFTPFileAttributes";
+NSString * const DLSFTPFileDigestKey = @"DLSFTPFileDigest";
 
 #import "DLSFTPFile.h"
 
@@ -38,10 +39,19 @@ NSString * const DLSFTPFileAttributesKey = @"DLSFTPFileAttributes";
 
 - (id)initWithPath:(NSString *)path
         attributes:(NSDictionary *)attributes {
+    return [self initWithPath:path
+                   attributes:attributes
+                       digest:nil];
+}
+
+- (id)initWithPath:(NSString *)path
+        attributes:(NSDictionary *)attributes
+            digest:(NSData *)digest {
     self = [super init];
     if (self) {
         _path = [path copy];
         _attributes = [attributes copy];
+        _digest = [digest copy];
     }
     return self;
 }
@@ -86,6 +96,7 @@ NSString * const DLSFTPFileAttributesKey = @"DLSFTPFileAttributes";
     if (self) {
         _path = [[aDecoder decodeObjectForKey:DLSFTPFilePathKey] copy];
         _attributes = [[aDecoder decodeObjectForKey:DLSFTPFileAttributesKey] copy];
+        _digest = [[aDecoder decodeObjectForKey:DLSFTPFileDigestKey] copy];
     }
     return self;
 }
@@ -93,6 +104,7 @@ NSString * const DLSFTPFileAttributesKey = @"DLSFTPFileAttributes";
 - (void)encodeWithCoder:(NSCoder *)aCoder {
     [aCoder encodeObject:self.path forKey:DLSFTPFilePathKey];
     [aCoder encodeObject:self.attributes forKey:DLSFTPFileAttributesKey];
+    [aCoder encodeObject:self.digest forKey:DLSFTPFileDigestKey];
 }
 
 @end;
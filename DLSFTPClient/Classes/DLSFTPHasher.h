@@ -0,0 +1,48 @@
+//
+//  DLSFTPHasher.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "DLSFTP.h"
+
+// Computes a hash of a transfer's content incrementally, as the chunks pass
+// through.  Not thread safe, requests update it on the socket queue
+@interface DLSFTPHasher : NSObject
+
+- (id)initWithAlgorithm:(eSFTPClientHashAlgorithm)algorithm;
+
+- (void)updateWithBytes:(const void *)bytes length:(size_t)length;
+- (void)updateWithData:(dispatch_data_t)data;
+// Hashes length bytes of the file at path, from the start
+- (BOOL)updateWithContentsOfFile:(NSString *)path length:(unsigned long long)length;
+// Returns the digest, big endian for CRC32C.  No further updates are allowed
+- (NSData *)finish;
+
+@end
@@ -0,0 +1,155 @@
+//
+//  DLSFTPHasher.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPHasher.h"
+#include <openssl/evp.h>
+
+// reflected CRC-32C (Castagnoli) polynomial, as used by iSCSI and cloud object stores
+static const uint32_t cCRC32CPolynomial = 0x82F63B78;
+static uint32_t crc32cTable[256];
+
+static void initCRC32CTable(void) {
+    for (uint32_t index = 0; index < 256; index++) {
+        uint32_t crc = index;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ cCRC32CPolynomial : crc >> 1;
+        }
+        crc32cTable[index] = crc;
+    }
+}
+
+@interface DLSFTPHasher ()
+
+@property (nonatomic, assign) eSFTPClientHashAlgorithm algorithm;
+@property (nonatomic, assign) EVP_MD_CTX *context;
+@property (nonatomic, assign) uint32_t crc;
+
+@end
+
+@implementation DLSFTPHasher
+
+- (id)initWithAlgorithm:(eSFTPClientHashAlgorithm)algorithm {
+    self = [super init];
+    if (self) {
+        self.algorithm = algorithm;
+        const EVP_MD *md = NULL;
+        switch (algorithm) {
+            case eSFTPClientHashAlgorithmMD5:
+                md = EVP_md5();
+                break;
+            case eSFTPClientHashAlgorithmSHA256:
+                md = EVP_sha256();
+                break;
+            case eSFTPClientHashAlgorithmCRC32C: {
+                static dispatch_once_t onceToken;
+                dispatch_once(&onceToken, ^{
+                    initCRC32CTable();
+                });
+                self.crc = 0xFFFFFFFF;
+                break;
+            }
+            default:
+                return nil;
+        }
+        if (md) {
+            self.context = EVP_MD_CTX_new();
+            if (self.context == NULL || EVP_DigestInit_ex(self.context, md, NULL) != 1) {
+                return nil;
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_context) {
+        EVP_MD_CTX_free(_context);
+        _context = NULL;
+    }
+}
+
+- (void)updateWithBytes:(const void *)bytes length:(size_t)length {
+    if (self.context) {
+        EVP_DigestUpdate(self.context, bytes, length);
+        return;
+    }
+    if (self.algorithm == eSFTPClientHashAlgorithmCRC32C) {
+        const uint8_t *buffer = bytes;
+        uint32_t crc = self.crc;
+        for (size_t index = 0; index < length; index++) {
+            crc = crc32cTable[(crc ^ buffer[index]) & 0xFF] ^ (crc >> 8);
+        }
+        self.crc = crc;
+    }
+}
+
+- (void)updateWithData:(dispatch_data_t)data {
+    dispatch_data_apply(data, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        [self updateWithBytes:buffer length:size];
+        return true;
+    });
+}
+
+- (BOOL)updateWithContentsOfFile:(NSString *)path length:(unsigned long long)length {
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (fileHandle == nil) {
+        return NO;
+    }
+    const NSUInteger chunkSize = 1024 * 1024;
+    unsigned long long remaining = length;
+    while (remaining > 0) {
+        @autoreleasepool {
+            NSData *chunk = [fileHandle readDataOfLength:(NSUInteger)MIN((unsigned long long)chunkSize, remaining)];
+            if ([chunk length] == 0) {
+                break;
+            }
+            [self updateWithBytes:[chunk bytes] length:[chunk length]];
+            remaining -= [chunk length];
+        }
+    }
+    [fileHandle closeFile];
+    return remaining == 0;
+}
+
+- (NSData *)finish {
+    if (self.context) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_DigestFinal_ex(self.context, digest, &length);
+        EVP_MD_CTX_free(self.context);
+        self.context = NULL;
+        return [NSData dataWithBytes:digest length:length];
+    }
+    uint32_t crc = CFSwapInt32HostToBig(self.crc ^ 0xFFFFFFFF);
+    return [NSData dataWithBytes:&crc length:sizeof(crc)];
+}
+
+@end
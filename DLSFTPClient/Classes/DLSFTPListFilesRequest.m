@@ -70,7 +70,7 @@ static const size_t cBufferSize = 8192;
     }
 
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
     // get a file handle for reading the directory
     LIBSSH2_SFTP_HANDLE *handle = NULL;
@@ -167,9 +167,9 @@ static const size_t cBufferSize = 8192;
     DLSFTPClientArraySuccessBlock successBlock = self.successBlock;
     NSArray *fileList = self.fileList;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             successBlock(fileList);
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
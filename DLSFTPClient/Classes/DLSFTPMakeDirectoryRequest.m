@@ -63,7 +63,7 @@
         return;
     }
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
 
     // sftp is now valid
@@ -127,9 +127,9 @@
     DLSFTPClientFileMetadataSuccessBlock successBlock = self.successBlock;
     DLSFTPFile *createdDirectory = self.createdDirectory;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             successBlock(createdDirectory);
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
@@ -67,7 +67,7 @@
         return;
     }
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
     int result;
 
@@ -127,9 +127,9 @@
     DLSFTPClientFileMetadataSuccessBlock successBlock = self.successBlock;
     DLSFTPFile *destinationItem = self.destinationItem;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             successBlock(destinationItem);
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
@@ -0,0 +1,53 @@
+//
+//  DLSFTPPrivateKey.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+// An in-memory private key that can be shared by many connections.
+// Reading the key from disk, and decrypting it when possible, happens once
+// here instead of on every connect.
+@interface DLSFTPPrivateKey : NSObject
+
+// Reads the key at keypath.  Encrypted PEM RSA, DSA and EC keys are decrypted
+// with the passphrase and kept unencrypted in memory.  Everything else, such
+// as OpenSSH format keys, unencrypted PEM and ed25519 keys, is kept as read
+// along with the passphrase for libssh2 to parse.
+- (id)initWithContentsOfFile:(NSString *)keypath
+                  passphrase:(NSString *)passphrase
+                       error:(NSError **)error;
+
+- (id)initWithKeyData:(NSData *)keyData
+           passphrase:(NSString *)passphrase;
+
+@property (nonatomic, copy, readonly) NSData *keyData;
+@property (nonatomic, copy, readonly) NSString *passphrase;
+
+@end
@@ -0,0 +1,55 @@
+//
+//  DLSFTPProgressReporter.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "DLSFTP.h"
+
+// Delivers a transfer's progress to its blocks.  Bytes are counted on the
+// transfer's queue and handed to a data add dispatch source targeting the
+// callback queue only once the request's progressInterval and
+// progressGranularity have both passed, so handlers fire at a bounded rate
+// however small the chunks are.  The final count is always delivered
+@interface DLSFTPProgressReporter : NSObject
+
+- (id)initWithQueue:(dispatch_queue_t)queue
+         bytesTotal:(unsigned long long)bytesTotal
+       initialBytes:(unsigned long long)initialBytes
+           interval:(NSTimeInterval)interval
+        granularity:(unsigned long long)granularity
+      progressBlock:(DLSFTPClientProgressBlock)progressBlock
+transferProgressBlock:(DLSFTPClientTransferProgressBlock)transferProgressBlock;
+
+// must always be called on the same serial queue
+- (void)addBytes:(unsigned long long)bytes;
+// reports any bytes not yet reported and stops reporting
+- (void)finish;
+
+@end
@@ -0,0 +1,156 @@
+//
+//  DLSFTPProgressReporter.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPProgressReporter.h"
+#import "DLSFTPTransferProgress.h"
+
+// weight of the latest rate in the average rate
+static const double cRateSmoothingFactor = 0.3;
+
+@interface DLSFTPProgressReporter ()
+
+@property (nonatomic) dispatch_source_t progressSource;
+@property (nonatomic, copy) void(^reportFinalBytes)(unsigned long long bytes); // invoked on the callback queue
+@property (nonatomic, assign) NSTimeInterval interval;
+@property (nonatomic, assign) unsigned long long granularity;
+
+// accessed on the queue adding bytes
+@property (nonatomic, assign) unsigned long long bytesAdded;
+@property (nonatomic, assign) unsigned long long bytesPending;
+@property (nonatomic, assign) CFAbsoluteTime lastMergeTime;
+
+@end
+
+@implementation DLSFTPProgressReporter
+
+@synthesize progressSource=_progressSource;
+
+- (id)initWithQueue:(dispatch_queue_t)queue
+         bytesTotal:(unsigned long long)bytesTotal
+       initialBytes:(unsigned long long)initialBytes
+           interval:(NSTimeInterval)interval
+        granularity:(unsigned long long)granularity
+      progressBlock:(DLSFTPClientProgressBlock)progressBlock
+transferProgressBlock:(DLSFTPClientTransferProgressBlock)transferProgressBlock {
+    self = [super init];
+    if (self) {
+        self.interval = interval;
+        self.granularity = granularity;
+        self.bytesAdded = initialBytes;
+        self.lastMergeTime = CFAbsoluteTimeGetCurrent();
+
+        // state of the reports, accessed on the callback queue by the source's handlers
+        __block unsigned long long bytesReported = initialBytes;
+        __block unsigned long long bytesLastReported = initialBytes;
+        __block CFAbsoluteTime lastReportTime = self.lastMergeTime;
+        __block double averageRate = 0.0;
+        void(^report)(BOOL) = ^(BOOL finished) {
+            if (progressBlock) {
+                progressBlock(bytesReported, bytesTotal);
+            }
+            if (transferProgressBlock) {
+                CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+                double rate = 0.0;
+                if (now > lastReportTime) {
+                    rate = (bytesReported - bytesLastReported) / (now - lastReportTime);
+                    averageRate = averageRate > 0.0 ? averageRate + cRateSmoothingFactor * (rate - averageRate) : rate;
+                }
+                lastReportTime = now;
+                bytesLastReported = bytesReported;
+                DLSFTPTransferProgress *progress = [[DLSFTPTransferProgress alloc] initWithBytesTransferred:bytesReported
+                                                                                                 bytesTotal:bytesTotal
+                                                                                          instantaneousRate:rate
+                                                                                                averageRate:averageRate
+                                                                                                   finished:finished];
+                transferProgressBlock(progress);
+            }
+        };
+
+        self.reportFinalBytes = ^(unsigned long long bytes) {
+            if (bytes > bytesReported) {
+                bytesReported = bytes;
+                report(YES);
+            }
+        };
+
+        dispatch_source_t progressSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, queue);
+        dispatch_source_set_event_handler(progressSource, ^{
+            bytesReported += dispatch_source_get_data(progressSource);
+            report(NO);
+        });
+        dispatch_resume(progressSource);
+        self.progressSource = progressSource;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self finish];
+}
+
+- (void)addBytes:(unsigned long long)bytes {
+    self.bytesAdded += bytes;
+    self.bytesPending += bytes;
+    if (self.bytesPending < self.granularity) {
+        return;
+    }
+    if (self.interval > 0) {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (now - self.lastMergeTime < self.interval) {
+            return;
+        }
+        self.lastMergeTime = now;
+    }
+    dispatch_source_merge_data(self.progressSource, self.bytesPending);
+    self.bytesPending = 0;
+}
+
+- (void)finish {
+    dispatch_source_t progressSource = self.progressSource;
+    if (progressSource == NULL) {
+        return;
+    }
+    // data merged just before cancelling may never reach the event handler,
+    // so the cancel handler reports the final count instead
+    void(^reportFinalBytes)(unsigned long long) = self.reportFinalBytes;
+    unsigned long long bytesAdded = self.bytesAdded;
+    dispatch_source_set_cancel_handler(progressSource, ^{
+        reportFinalBytes(bytesAdded);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(progressSource);
+#endif
+    });
+    dispatch_source_cancel(progressSource);
+    self.progressSource = NULL;
+    self.bytesPending = 0;
+}
+
+@end
@@ -0,0 +1,64 @@
+//
+//  DLSFTPRemoteChecksumRequest.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPRequest.h"
+
+// Hashes files on the server by running a checksum program such as sha256sum
+// in an exec channel on the connection's SSH session, so a remote file can be
+// compared with a local one without downloading it.  Needs shell access on the
+// server, not only SFTP.  successBlock receives a dictionary of remote path to
+// NSData digest.  Paths the program could not hash, such as missing files,
+// are left out
+@interface DLSFTPRemoteChecksumRequest : DLSFTPRequest
+
+- (id)initWithPaths:(NSArray *)paths
+          algorithm:(eSFTPClientHashAlgorithm)algorithm
+       successBlock:(DLSFTPClientDictionarySuccessBlock)successBlock
+       failureBlock:(DLSFTPClientFailureBlock)failureBlock;
+
+- (id)initWithPath:(NSString *)path
+         algorithm:(eSFTPClientHashAlgorithm)algorithm
+      successBlock:(DLSFTPClientDictionarySuccessBlock)successBlock
+      failureBlock:(DLSFTPClientFailureBlock)failureBlock;
+
+// The program run with the quoted paths as arguments.  It must print lines in
+// one of the forms digestsFromOutput:forPaths: accepts.  Defaults to md5sum or
+// sha256sum for the algorithm, and must be set for
+// eSFTPClientHashAlgorithmCRC32C, which has no standard program
+@property (nonatomic, copy) NSString *command;
+
+// Parses the command's output into a dictionary of path to digest, for the
+// paths given.  Accepts "<hex digest>  <path>" and binary mode's
+// "<hex digest> *<path>" from coreutils, including its escaped lines, which
+// start with a backslash, and "<hex digest> <path>" from BSD -r
++ (NSDictionary *)digestsFromOutput:(NSString *)output forPaths:(NSArray *)paths;
+
+@end
@@ -0,0 +1,468 @@
+//
+//  DLSFTPRemoteChecksumRequest.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPRemoteChecksumRequest.h"
+#import "DLSFTPConnection.h"
+
+// exit status of a shell that could not find or run the command
+static const int cCommandNotFoundStatus = 127;
+static const int cCommandNotExecutableStatus = 126;
+// seconds to wait for the socket before retrying a step that would block
+// anyway, as another request's read may already have taken this channel's data
+static const NSTimeInterval cStepRetryInterval = 1.0;
+
+@interface DLSFTPRemoteChecksumRequest ()
+
+@property (nonatomic, copy) NSArray *paths;
+@property (nonatomic, assign) eSFTPClientHashAlgorithm algorithm;
+@property (nonatomic, strong) NSDictionary *digests;
+@property (nonatomic, assign) LIBSSH2_CHANNEL *channel;
+// the session the channel was opened on
+@property (nonatomic, assign) LIBSSH2_SESSION *channelSession;
+@property (nonatomic, strong) NSMutableData *output;
+@property (nonatomic, strong) NSMutableData *errorOutput;
+@property (nonatomic, assign) int exitStatus;
+// the step waiting for the socket, and the sources that will run it
+@property (nonatomic, copy) dispatch_block_t pendingStep;
+@property (nonatomic) dispatch_source_t socketSource;
+@property (nonatomic) dispatch_source_t retryTimer;
+
+@end
+
+@implementation DLSFTPRemoteChecksumRequest
+
+@synthesize socketSource=_socketSource;
+@synthesize retryTimer=_retryTimer;
+
+- (id)initWithPaths:(NSArray *)paths
+          algorithm:(eSFTPClientHashAlgorithm)algorithm
+       successBlock:(DLSFTPClientDictionarySuccessBlock)successBlock
+       failureBlock:(DLSFTPClientFailureBlock)failureBlock {
+    self = [super init];
+    if (self) {
+        self.paths = paths;
+        self.algorithm = algorithm;
+        self.successBlock = successBlock;
+        self.failureBlock = failureBlock;
+        switch (algorithm) {
+            case eSFTPClientHashAlgorithmMD5:
+                self.command = @"md5sum";
+                break;
+            case eSFTPClientHashAlgorithmSHA256:
+                self.command = @"sha256sum";
+                break;
+            default:
+                break;
+        }
+    }
+    return self;
+}
+
+- (id)initWithPath:(NSString *)path
+         algorithm:(eSFTPClientHashAlgorithm)algorithm
+      successBlock:(DLSFTPClientDictionarySuccessBlock)successBlock
+      failureBlock:(DLSFTPClientFailureBlock)failureBlock {
+    return [self initWithPaths:(path ? @[ path ] : @[])
+                     algorithm:algorithm
+                  successBlock:successBlock
+                  failureBlock:failureBlock];
+}
+
+- (void)dealloc {
+    [self cancelStepSources];
+}
+
+// quoted for a POSIX shell, which takes everything between single quotes literally
++ (NSString *)quotedArgument:(NSString *)argument {
+    NSString *escaped = [argument stringByReplacingOccurrencesOfString:@"'" withString:@"'\\''"];
+    return [NSString stringWithFormat:@"'%@'", escaped];
+}
+
+- (NSString *)commandLine {
+    NSMutableArray *arguments = [NSMutableArray arrayWithObjects:self.command, @"--", nil];
+    for (NSString *path in self.paths) {
+        [arguments addObject:[[self class] quotedArgument:path]];
+    }
+    return [arguments componentsJoinedByString:@" "];
+}
+
+- (void)start {
+    for (NSString *path in self.paths) {
+        if ([self pathIsValid:path] == NO) {
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+    }
+    if ([self.paths count] == 0) {
+        self.error = [self errorWithCode:eSFTPClientErrorInvalidPath
+                        errorDescription:@"No paths to checksum"
+                         underlyingError:nil];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    if ([self.command length] == 0) {
+        self.error = [self errorWithCode:eSFTPClientErrorNotImplemented
+                        errorDescription:@"No remote checksum command for this algorithm"
+                         underlyingError:nil];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    if ([self ready] == NO) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    self.output = [NSMutableData data];
+    self.errorOutput = [NSMutableData data];
+    [self openChannel];
+}
+
+// Each step below makes a single libssh2 call on the socket queue, as hashing
+// a large file can take minutes and other requests share the session.  A step
+// that would block runs again once the socket is ready in the direction
+// libssh2 is waiting for, leaving the queue free meanwhile
+- (void)performStepWhenSocketIsReady:(dispatch_block_t)step {
+    dispatch_queue_t socketQueue = self.connection.socketQueue;
+    if (socketQueue == NULL) {
+        return;
+    }
+    self.pendingStep = step;
+    __weak DLSFTPRemoteChecksumRequest *weakSelf = self;
+    int directions = libssh2_session_block_directions([self.connection session]);
+    dispatch_source_type_t type = (directions & LIBSSH2_SESSION_BLOCK_OUTBOUND) ? DISPATCH_SOURCE_TYPE_WRITE : DISPATCH_SOURCE_TYPE_READ;
+    dispatch_source_t socketSource = dispatch_source_create(type, [self.connection socket], 0, socketQueue);
+    dispatch_source_set_event_handler(socketSource, ^{
+        [weakSelf performPendingStep];
+    });
+    self.socketSource = socketSource;
+    dispatch_source_t retryTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, socketQueue);
+    dispatch_time_t retryTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(cStepRetryInterval * NSEC_PER_SEC));
+    dispatch_source_set_timer(retryTimer, retryTime, DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+    dispatch_source_set_event_handler(retryTimer, ^{
+        [weakSelf performPendingStep];
+    });
+    self.retryTimer = retryTimer;
+    dispatch_resume(socketSource);
+    dispatch_resume(retryTimer);
+}
+
+// called on the socket queue by whichever source fires first
+- (void)performPendingStep {
+    dispatch_block_t step = self.pendingStep;
+    self.pendingStep = nil;
+    [self cancelStepSources];
+    if (step) {
+        step();
+    }
+}
+
+- (void)cancelStepSources {
+    if (_socketSource) {
+        dispatch_source_cancel(_socketSource);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(_socketSource);
+#endif
+        _socketSource = NULL;
+    }
+    if (_retryTimer) {
+        dispatch_source_cancel(_retryTimer);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(_retryTimer);
+#endif
+        _retryTimer = NULL;
+    }
+}
+
+// a step waiting for the socket runs now, to notice the cancellation
+- (void)didCancel {
+    dispatch_queue_t socketQueue = self.connection.socketQueue;
+    if (socketQueue) {
+        __weak DLSFTPRemoteChecksumRequest *weakSelf = self;
+        dispatch_async(socketQueue, ^{
+            [weakSelf performPendingStep];
+        });
+    }
+}
+
+- (NSError *)commandFailedError:(int)result {
+    NSString *errorDescription = [NSString stringWithFormat:@"Remote checksum failed: libssh2 error %d", result];
+    return [self errorWithCode:eSFTPClientErrorRemoteCommandFailed
+              errorDescription:errorDescription
+               underlyingError:@(result)];
+}
+
+- (void)openChannel {
+    if ([self ready] == NO) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    // Opened in one go rather than in steps.  libssh2 keeps the state of an
+    // open in progress on the session, where an sftp restart run in between
+    // would pick it up.  Opening is brief, so it isn't interrupted by a cancel
+    LIBSSH2_SESSION *session = [self.connection session];
+    int socketFD = [self.connection socket];
+    LIBSSH2_CHANNEL *channel = NULL;
+    while (   (channel = libssh2_channel_open_session(session)) == NULL
+           && libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN
+           && [self.connection isConnected]) {
+        waitsocket(socketFD, session);
+    }
+    if (channel) {
+        self.channel = channel;
+        self.channelSession = session;
+        [self execCommand];
+        return;
+    }
+    int lastError = libssh2_session_last_errno(session);
+    NSString *errorDescription = [NSString stringWithFormat:@"Unable to open an exec channel: libssh2 error %d", lastError];
+    self.error = [self errorWithCode:eSFTPClientErrorUnableToCreateChannel
+                    errorDescription:errorDescription
+                     underlyingError:@(lastError)];
+    [self.connection requestDidFail:self withError:self.error];
+}
+
+- (void)execCommand {
+    if ([self ready] == NO) {
+        [self closeChannel];
+        return;
+    }
+    int result = libssh2_channel_exec(self.channel, [[self commandLine] UTF8String]);
+    if (result == LIBSSH2_ERROR_EAGAIN) {
+        [self performStepWhenSocketIsReady:^{ [self execCommand]; }];
+        return;
+    }
+    if (result) {
+        self.error = [self commandFailedError:result];
+        [self closeChannel];
+        return;
+    }
+    [self readOutput];
+}
+
+// Reads what has arrived on stdout and stderr, draining both so neither fills
+// the channel window, until the channel's end of file
+- (void)readOutput {
+    if ([self ready] == NO) {
+        [self closeChannel];
+        return;
+    }
+    char buffer[4096];
+    ssize_t bytesRead;
+    ssize_t errorBytesRead;
+    do {
+        bytesRead = libssh2_channel_read(self.channel, buffer, sizeof(buffer));
+        if (bytesRead > 0) {
+            [self.output appendBytes:buffer length:bytesRead];
+        }
+        errorBytesRead = libssh2_channel_read_stderr(self.channel, buffer, sizeof(buffer));
+        if (errorBytesRead > 0) {
+            [self.errorOutput appendBytes:buffer length:errorBytesRead];
+        }
+        if (bytesRead > 0 || errorBytesRead > 0) {
+            [self noteActivity];
+        }
+    } while (bytesRead > 0 || errorBytesRead > 0);
+
+    if (bytesRead < 0 && bytesRead != LIBSSH2_ERROR_EAGAIN) {
+        self.error = [self commandFailedError:(int)bytesRead];
+        [self closeChannel];
+    } else if (errorBytesRead < 0 && errorBytesRead != LIBSSH2_ERROR_EAGAIN) {
+        self.error = [self commandFailedError:(int)errorBytesRead];
+        [self closeChannel];
+    } else if (libssh2_channel_eof(self.channel)) {
+        [self closeChannel];
+    } else {
+        [self performStepWhenSocketIsReady:^{ [self readOutput]; }];
+    }
+}
+
+// Waits for the command's exit status, unless stopping early, in which case
+// freeing the channel closes it
+- (void)closeChannel {
+    if (self.error == nil && [self ready]) {
+        int result = libssh2_channel_close(self.channel);
+        if (result == LIBSSH2_ERROR_EAGAIN) {
+            [self performStepWhenSocketIsReady:^{ [self closeChannel]; }];
+            return;
+        }
+        if (result) {
+            self.error = [self commandFailedError:result];
+        } else {
+            self.exitStatus = libssh2_channel_get_exit_status(self.channel);
+        }
+    }
+    [self freeChannel];
+}
+
+- (void)freeChannel {
+    // the channel went with its session if the connection was closed meanwhile
+    if (self.channel && [self.connection session] == self.channelSession) {
+        int result = libssh2_channel_free(self.channel);
+        if (result == LIBSSH2_ERROR_EAGAIN) {
+            [self performStepWhenSocketIsReady:^{ [self freeChannel]; }];
+            return;
+        }
+    }
+    self.channel = NULL;
+    self.channelSession = NULL;
+    [self commandFinished];
+}
+
+- (void)commandFinished {
+    if (self.error) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    if (self.exitStatus == cCommandNotFoundStatus || self.exitStatus == cCommandNotExecutableStatus) {
+        NSString *message = [[NSString alloc] initWithData:self.errorOutput encoding:NSUTF8StringEncoding];
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to run %@: %@", self.command, message];
+        self.error = [self errorWithCode:eSFTPClientErrorRemoteCommandFailed
+                        errorDescription:errorDescription
+                         underlyingError:@(self.exitStatus)];
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
+    // a nonzero status otherwise means some paths could not be read, and are left out
+    NSString *output = [[NSString alloc] initWithData:self.output encoding:NSUTF8StringEncoding];
+    self.digests = [[self class] digestsFromOutput:output forPaths:self.paths];
+    self.output = nil;
+    self.errorOutput = nil;
+    [self.connection requestDidComplete:self];
+}
+
++ (NSDictionary *)digestsFromOutput:(NSString *)output forPaths:(NSArray *)paths {
+    NSMutableDictionary *digests = [NSMutableDictionary dictionaryWithCapacity:[paths count]];
+    for (NSString *outputLine in [output componentsSeparatedByString:@"\n"]) {
+        NSString *line = outputLine;
+        BOOL escaped = [line hasPrefix:@"\\"];
+        if (escaped) {
+            line = [line substringFromIndex:1];
+        }
+        NSRange separator = [line rangeOfString:@" "];
+        if (separator.location == NSNotFound) {
+            continue;
+        }
+        NSData *digest = [self dataFromHexString:[line substringToIndex:separator.location]];
+        if (digest == nil) {
+            continue;
+        }
+        // "  " or " *" in GNU output, " " in BSD output
+        NSString *rest = [line substringFromIndex:NSMaxRange(separator)];
+        NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:2];
+        if ([rest hasPrefix:@" "] || [rest hasPrefix:@"*"]) {
+            [candidates addObject:[rest substringFromIndex:1]];
+        }
+        [candidates addObject:rest];
+        for (NSString *candidate in candidates) {
+            NSString *path = escaped ? [self unescapedPath:candidate] : candidate;
+            if (path && [paths containsObject:path]) {
+                [digests setObject:digest forKey:path];
+                break;
+            }
+        }
+    }
+    return digests;
+}
+
+// undoes coreutils' escaping of backslash, newline and carriage return, in one
+// pass so an escaped backslash followed by n stays a backslash and n.  Returns
+// nil for an unknown escape
++ (NSString *)unescapedPath:(NSString *)path {
+    NSMutableString *unescaped = [NSMutableString stringWithCapacity:[path length]];
+    NSUInteger length = [path length];
+    for (NSUInteger index = 0; index < length; index++) {
+        unichar character = [path characterAtIndex:index];
+        if (character == '\\') {
+            if (++index == length) {
+                return nil;
+            }
+            switch ([path characterAtIndex:index]) {
+                case '\\':
+                    character = '\\';
+                    break;
+                case 'n':
+                    character = '\n';
+                    break;
+                case 'r':
+                    character = '\r';
+                    break;
+                default:
+                    return nil;
+            }
+        }
+        [unescaped appendFormat:@"%C", character];
+    }
+    return unescaped;
+}
+
+static int hexDigitValue(unichar character) {
+    if (character >= '0' && character <= '9') {
+        return character - '0';
+    }
+    if (character >= 'a' && character <= 'f') {
+        return character - 'a' + 10;
+    }
+    if (character >= 'A' && character <= 'F') {
+        return character - 'A' + 10;
+    }
+    return -1;
+}
+
++ (NSData *)dataFromHexString:(NSString *)hexString {
+    NSUInteger length = [hexString length];
+    if (length == 0 || length % 2 != 0) {
+        return nil;
+    }
+    NSMutableData *data = [NSMutableData dataWithCapacity:length / 2];
+    for (NSUInteger index = 0; index < length; index += 2) {
+        int high = hexDigitValue([hexString characterAtIndex:index]);
+        int low = hexDigitValue([hexString characterAtIndex:index + 1]);
+        if (high < 0 || low < 0) {
+            return nil;
+        }
+        uint8_t value = (uint8_t)((high << 4) | low);
+        [data appendBytes:&value length:1];
+    }
+    return data;
+}
+
+- (void)succeed {
+    DLSFTPClientDictionarySuccessBlock successBlock = self.successBlock;
+    NSDictionary *digests = self.digests;
+    if (successBlock) {
+        [self dispatchCallback:^{
+            successBlock(digests);
+        }];
+    }
+    self.successBlock = nil;
+    self.failureBlock = nil;
+}
+
+@end
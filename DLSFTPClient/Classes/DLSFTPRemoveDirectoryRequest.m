@@ -60,7 +60,7 @@
         return;
     }
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
 
     // sftp is now valid
@@ -90,9 +90,9 @@
 - (void)succeed {
     DLSFTPClientSuccessBlock successBlock = self.successBlock;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             successBlock();
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
@@ -36,15 +36,59 @@
 typedef void(^DLSFTPRequestCancelHandler)(void);
 
 @class DLSFTPConnection;
+@class DLSFTPRetryPolicy;
+@class DLSFTPBatchRequest;
 
 @interface DLSFTPRequest : NSObject
 
 @property (nonatomic, readonly, getter = isCancelled) BOOL cancelled;
 @property (nonatomic, weak) DLSFTPConnection *connection;
+// the sftp channel this request runs on, assigned by the connection before start
+@property (nonatomic, assign) LIBSSH2_SFTP *sftp;
 @property (nonatomic, readwrite, copy) DLSFTPRequestCancelHandler cancelHandler;
 @property (nonatomic, strong) NSError *error;
 @property (nonatomic, copy) id successBlock;
 @property (nonatomic, copy) DLSFTPClientFailureBlock failureBlock;
+// defaults to eSFTPClientRequestPriorityNormal, set before submitting
+@property (nonatomic, assign) eSFTPClientRequestPriority priority;
+// For transfers, the minimum seconds and bytes between progress reports.
+// Both default to 0, reporting as often as the callback queue keeps up
+@property (nonatomic, assign) NSTimeInterval progressInterval;
+@property (nonatomic, assign) unsigned long long progressGranularity;
+// For transfers, invoked with the progress, rates and estimated time
+// remaining, alongside the progress block
+@property (nonatomic, copy) DLSFTPClientTransferProgressBlock transferProgressBlock;
+// For transfers, a hash computed over the data as it is transferred, without
+// reading the local file again.  The digest is set on the DLSFTPFile passed to
+// the success block.  Defaults to eSFTPClientHashAlgorithmNone
+@property (nonatomic, assign) eSFTPClientHashAlgorithm hashAlgorithm;
+// Queue the request's blocks are invoked on.  Defaults to NULL, which uses
+// the connection's callbackQueue
+@property (nonatomic, strong) dispatch_queue_t callbackQueue;
+// Seconds the request may run for, measured from when it starts rather than
+// when it is submitted.  0, the default, means no limit
+@property (nonatomic, assign) NSTimeInterval timeout;
+// Seconds the request may run without transferring any data.  0, the default,
+// means no limit
+@property (nonatomic, assign) NSTimeInterval inactivityTimeout;
+// YES if the request failed with eSFTPClientErrorRequestTimedOut
+@property (nonatomic, readonly, getter = isTimedOut) BOOL timedOut;
+// If set, failures the policy considers transient are retried by the
+// connection instead of invoking the failure block.  Defaults to nil
+@property (nonatomic, strong) DLSFTPRetryPolicy *retryPolicy;
+// Number of times the request has been retried
+@property (nonatomic, readonly) NSUInteger retryCount;
+// the batch running this request, if it is not scheduled by itself
+@property (nonatomic, weak) DLSFTPBatchRequest *batchRequest;
+// set by the connection once the request has succeeded or failed
+@property (nonatomic, assign, getter = isFinished) BOOL finished;
+@property (nonatomic, readonly) NSArray *dependencies;
+
+// The request will not start until request has succeeded, and fails with
+// eSFTPClientErrorDependencyFailed if request fails or is removed.  Both must
+// be submitted to the same connection, request first, or the request fails
+// the same way.  Call before submitting
+- (void)addDependency:(DLSFTPRequest *)request;
 
 // may be called by the connection or the end user
 - (void)cancel;
@@ -53,11 +97,29 @@ typedef void(^DLSFTPRequestCancelHandler)(void);
 - (void)start; // subclasses must override
 - (void)succeed; // subclasses must override and invoke their success blocks
 - (void)fail; // subclasses need not override this
+- (void)startTimeoutTimer;
+- (void)stopTimeoutTimer;
+- (BOOL)shouldRetry;
+// subclasses may override to carry progress into the next attempt, and must call super
+- (void)prepareForRetry;
+// Invoked once the request is cancelled or times out, on any queue.  Subclasses
+// that wait on something other than the socket override this to stop waiting
+- (void)didCancel;
+// YES if the request stopped partway through an sftp operation, so its channel
+// must be restarted before anything else runs on it.  Defaults to isCancelled
+- (BOOL)isInterrupted;
+// YES if the request yields the socket queue between chunks, letting higher
+// priority requests run on its channel before it finishes. Defaults to NO
+- (BOOL)isPreemptible;
 
 // Only subclasses should call these methods
 - (BOOL)ready;
 - (BOOL)pathIsValid:(NSString *)path;
 - (BOOL)checkSftp;
+- (void)noteActivity; // call when data is transferred, to defer the inactivity timeout
+- (NSError *)cancellationError; // the error for a request stopped by cancel or a timeout
+- (dispatch_queue_t)targetCallbackQueue;
+- (void)dispatchCallback:(dispatch_block_t)block; // invokes the block on the target callback queue
 - (NSError *)errorWithCode:(eSFTPClientErrorCode)errorCode
           errorDescription:(NSString *)errorDescription
            underlyingError:(NSNumber *)underlyingError;
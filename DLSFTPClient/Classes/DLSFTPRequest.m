@@ -31,24 +31,47 @@
 
 #import "DLSFTPRequest.h"
 #import "DLSFTPConnection.h"
+#import "DLSFTPRetryPolicy.h"
 
 static NSString * const DLSFTPRequestNotImplemented = @"DLSFTPRequestMethodNotImplemented";
 
-@interface DLSFTPRequest ()
+@interface DLSFTPRequest () {
+    dispatch_source_t _timeoutTimer;
+}
 
 @property (nonatomic, readwrite, getter = isCancelled) BOOL cancelled;
+@property (nonatomic, readwrite, getter = isTimedOut) BOOL timedOut;
+@property (nonatomic, readwrite) NSUInteger retryCount;
+@property (nonatomic, strong) NSMutableArray *mutableDependencies;
+@property (nonatomic, assign) CFAbsoluteTime startedTime;
+@property (nonatomic, assign) CFAbsoluteTime lastActivityTime;
 
 @end
 
 @implementation DLSFTPRequest
 
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.priority = eSFTPClientRequestPriorityNormal;
+        self.mutableDependencies = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
 - (void)cancel {
     if (self.cancelHandler) {
         DLSFTPRequestCancelHandler handler = self.cancelHandler;
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), handler);
+        [self dispatchCallback:handler];
         self.cancelHandler = nil;
     }
     self.cancelled = YES;
+    // don't leave the request waiting on the socket to notice
+    [self.connection wakeup];
+    [self didCancel];
+}
+
+- (void)didCancel {
 }
 
 - (void)start {
@@ -61,12 +84,168 @@ static NSString * const DLSFTPRequestNotImplemented = @"DLSFTPRequestMethodNotIm
                 format:@"Request does not implement finish"];
 }
 
+- (BOOL)isPreemptible {
+    return NO;
+}
+
+- (BOOL)isInterrupted {
+    return self.isCancelled;
+}
+
+- (NSArray *)dependencies {
+    return [self.mutableDependencies copy];
+}
+
+- (void)addDependency:(DLSFTPRequest *)request {
+    if (request && request != self && [self.mutableDependencies containsObject:request] == NO) {
+        [self.mutableDependencies addObject:request];
+    }
+}
+
+#pragma mark Callbacks
+
+- (dispatch_queue_t)targetCallbackQueue {
+    dispatch_queue_t queue = self.callbackQueue;
+    if (queue == NULL) {
+        queue = self.connection.callbackQueue;
+    }
+    if (queue == NULL) {
+        queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    }
+    return queue;
+}
+
+- (void)dispatchCallback:(dispatch_block_t)block {
+    DLSFTPConnection *connection = self.connection;
+    if (connection) {
+        [connection dispatchCallback:block toQueue:[self targetCallbackQueue]];
+    } else {
+        dispatch_async([self targetCallbackQueue], block);
+    }
+}
+
+#pragma mark Retries
+
+- (BOOL)shouldRetry {
+    if (self.retryPolicy == nil || (self.isCancelled && self.isTimedOut == NO)) {
+        // never retry a request the user cancelled
+        return NO;
+    }
+    NSError *error = self.isTimedOut ? [self cancellationError] : self.error;
+    return [self.retryPolicy shouldRetryError:error afterAttempt:self.retryCount + 1];
+}
+
+- (void)prepareForRetry {
+    self.retryCount += 1;
+    // only timed out requests are retried after being cancelled
+    self.cancelled = NO;
+    self.timedOut = NO;
+    self.error = nil;
+    self.sftp = NULL;
+}
+
+#pragma mark Timeouts
+
+- (void)startTimeoutTimer {
+    self.startedTime = CFAbsoluteTimeGetCurrent();
+    self.lastActivityTime = self.startedTime;
+    if (self.timeout <= 0 && self.inactivityTimeout <= 0) {
+        return;
+    }
+    // on the socket queue, so a timeout never races the request finishing
+    _timeoutTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.connection.socketQueue);
+    __weak DLSFTPRequest *weakSelf = self;
+    dispatch_source_set_event_handler(_timeoutTimer, ^{
+        [weakSelf checkTimeouts];
+    });
+    [self checkTimeouts];
+    dispatch_resume(_timeoutTimer);
+}
+
+- (void)stopTimeoutTimer {
+    if (_timeoutTimer) {
+        dispatch_source_cancel(_timeoutTimer);
+        #if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(_timeoutTimer);
+        #endif
+        _timeoutTimer = NULL;
+    }
+}
+
+- (void)dealloc {
+    [self stopTimeoutTimer];
+}
+
+// the earliest deadline, or DBL_MAX if there is none
+- (CFAbsoluteTime)timeoutDeadline {
+    CFAbsoluteTime deadline = DBL_MAX;
+    if (self.timeout > 0) {
+        deadline = self.startedTime + self.timeout;
+    }
+    if (self.inactivityTimeout > 0) {
+        deadline = MIN(deadline, self.lastActivityTime + self.inactivityTimeout);
+    }
+    return deadline;
+}
+
+// Called on the socket queue.  Times out the request, or sets the timer to
+// fire at the next deadline.  Activity only moves the inactivity deadline
+// later, so it is never missed
+- (void)checkTimeouts {
+    dispatch_source_t timer = _timeoutTimer;
+    if (timer == NULL || _cancelled) {
+        return;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime deadline = [self timeoutDeadline];
+    if (now >= deadline) {
+        // stop the request the same way cancel does, but without the cancel handler
+        self.timedOut = YES;
+        self.cancelled = YES;
+        [self didCancel];
+        return;
+    }
+    dispatch_time_t fireTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)((deadline - now) * NSEC_PER_SEC));
+    dispatch_source_set_timer(timer, fireTime, DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+    // the timer can't fire while the request waits on the socket inside a
+    // socket queue block, so wake the wait to have isCancelled check instead
+    __weak DLSFTPConnection *weakConnection = self.connection;
+    dispatch_after(fireTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [weakConnection wakeup];
+    });
+}
+
+// Requests poll this between libssh2 calls on the socket queue, so a running
+// request also times out there, while an operation is blocked on the socket
+- (BOOL)isCancelled {
+    if (   _cancelled == NO
+        && _timeoutTimer
+        && [self.connection isOnSocketQueue]
+        && CFAbsoluteTimeGetCurrent() >= [self timeoutDeadline]) {
+        [self checkTimeouts];
+    }
+    return _cancelled;
+}
+
+- (void)noteActivity {
+    self.lastActivityTime = CFAbsoluteTimeGetCurrent();
+}
+
+- (NSError *)cancellationError {
+    if (self.isTimedOut) {
+        return [self errorWithCode:eSFTPClientErrorRequestTimedOut
+                  errorDescription:@"Request timed out"
+                   underlyingError:nil];
+    }
+    return [self errorWithCode:eSFTPClientErrorCancelledByUser
+              errorDescription:@"Cancelled by user"
+               underlyingError:nil];
+}
+
 // potentially move these to the connection
 - (BOOL)ready {
     if (self.isCancelled) {
-        self.error = [self errorWithCode:eSFTPClientErrorCancelledByUser
-                        errorDescription:@"Cancelled by user"
-                         underlyingError:nil];
+        self.error = [self cancellationError];
         return NO;
     }
     if ([self.connection isConnected] == NO) {
@@ -89,7 +268,7 @@ static NSString * const DLSFTPRequestNotImplemented = @"DLSFTPRequestMethodNotIm
 
 - (BOOL)checkSftp {
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     if (sftp == NULL) {
         // unable to initialize sftp
         int lastError = libssh2_session_last_errno(session);
@@ -127,12 +306,16 @@ static NSString * const DLSFTPRequestNotImplemented = @"DLSFTPRequestMethodNotIm
 }
 
 - (void)fail {
+    if (self.isTimedOut) {
+        // whatever operation the timeout interrupted, report the timeout
+        self.error = [self cancellationError];
+    }
     DLSFTPClientFailureBlock failureBlock = self.failureBlock;
     NSError *error = self.error;
     if (failureBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             failureBlock(error);
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
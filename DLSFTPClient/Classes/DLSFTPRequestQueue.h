@@ -0,0 +1,56 @@
+//
+//  DLSFTPRequestQueue.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "DLSFTP.h"
+
+// Requests waiting to be started by a connection, with a first in first out
+// queue per priority.  Adding and taking the next request are O(1), and so is
+// removal: a removed request's entry is only marked, and skipped once it
+// reaches the front of its queue.  Not thread safe, the connection serializes
+// access on its request queue
+@interface DLSFTPRequestQueue : NSObject
+
+- (NSUInteger)count;
+- (BOOL)containsRequest:(DLSFTPRequest *)request;
+- (void)addRequest:(DLSFTPRequest *)request;
+// adds the request ahead of the others of its priority
+- (void)addRequestToFront:(DLSFTPRequest *)request;
+- (BOOL)removeRequest:(DLSFTPRequest *)request;
+// removes and returns the oldest request of the highest priority, or nil if empty
+- (DLSFTPRequest *)nextRequest;
+// returns the request nextRequest would, without removing it
+- (DLSFTPRequest *)peekRequest;
+// as nextRequest, but only considers priorities higher than priority
+- (DLSFTPRequest *)nextRequestWithPriorityAbove:(eSFTPClientRequestPriority)priority;
+- (NSArray *)removeAllRequests;
+
+@end
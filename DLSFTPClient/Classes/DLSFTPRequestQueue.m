@@ -0,0 +1,170 @@
+//
+//  DLSFTPRequestQueue.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPRequestQueue.h"
+#import "DLSFTPRequest.h"
+
+// the handle to a queued request, so the request can be resubmitted once removed
+@interface DLSFTPRequestQueueEntry : NSObject
+
+@property (nonatomic, strong) DLSFTPRequest *request;
+@property (nonatomic, assign, getter = isRemoved) BOOL removed;
+
+@end
+
+@implementation DLSFTPRequestQueueEntry
+@end
+
+@interface DLSFTPRequestQueue ()
+
+@property (nonatomic, strong) NSArray *queues; // NSMutableArray of entries, indexed by priority
+@property (nonatomic, strong) NSMapTable *entries; // request to its entry
+
+- (DLSFTPRequest *)nextRequestWithPriorityFrom:(NSInteger)lowestPriority;
+
+@end
+
+@implementation DLSFTPRequestQueue
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        NSMutableArray *queues = [[NSMutableArray alloc] initWithCapacity:SFTPClientRequestPriorityCount];
+        for (NSUInteger priority = 0; priority < SFTPClientRequestPriorityCount; priority++) {
+            [queues addObject:[[NSMutableArray alloc] init]];
+        }
+        self.queues = queues;
+        self.entries = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                             valueOptions:NSPointerFunctionsStrongMemory];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return [self.entries count];
+}
+
+- (BOOL)containsRequest:(DLSFTPRequest *)request {
+    return [self.entries objectForKey:request] != nil;
+}
+
+- (NSMutableArray *)queueForPriority:(eSFTPClientRequestPriority)priority {
+    NSUInteger index = MIN((NSUInteger)priority, (NSUInteger)SFTPClientRequestPriorityCount - 1);
+    return [self.queues objectAtIndex:index];
+}
+
+- (DLSFTPRequestQueueEntry *)entryForNewRequest:(DLSFTPRequest *)request {
+    if ([self containsRequest:request]) {
+        return nil;
+    }
+    DLSFTPRequestQueueEntry *entry = [[DLSFTPRequestQueueEntry alloc] init];
+    entry.request = request;
+    [self.entries setObject:entry forKey:request];
+    return entry;
+}
+
+- (void)addRequest:(DLSFTPRequest *)request {
+    DLSFTPRequestQueueEntry *entry = [self entryForNewRequest:request];
+    if (entry) {
+        [[self queueForPriority:request.priority] addObject:entry];
+    }
+}
+
+- (void)addRequestToFront:(DLSFTPRequest *)request {
+    DLSFTPRequestQueueEntry *entry = [self entryForNewRequest:request];
+    if (entry) {
+        [[self queueForPriority:request.priority] insertObject:entry atIndex:0];
+    }
+}
+
+- (BOOL)removeRequest:(DLSFTPRequest *)request {
+    DLSFTPRequestQueueEntry *entry = [self.entries objectForKey:request];
+    if (entry == nil) {
+        return NO;
+    }
+    entry.removed = YES;
+    entry.request = nil;
+    [self.entries removeObjectForKey:request];
+    return YES;
+}
+
+- (DLSFTPRequest *)nextRequest {
+    return [self nextRequestWithPriorityFrom:eSFTPClientRequestPriorityBulk];
+}
+
+- (DLSFTPRequest *)peekRequest {
+    for (NSMutableArray *queue in [self.queues reverseObjectEnumerator]) {
+        while ([queue count] > 0) {
+            DLSFTPRequestQueueEntry *entry = [queue objectAtIndex:0];
+            if (entry.isRemoved == NO) {
+                return entry.request;
+            }
+            [queue removeObjectAtIndex:0];
+        }
+    }
+    return nil;
+}
+
+- (DLSFTPRequest *)nextRequestWithPriorityAbove:(eSFTPClientRequestPriority)priority {
+    return [self nextRequestWithPriorityFrom:(NSInteger)priority + 1];
+}
+
+- (DLSFTPRequest *)nextRequestWithPriorityFrom:(NSInteger)lowestPriority {
+    for (NSInteger index = SFTPClientRequestPriorityCount - 1; index >= lowestPriority; index--) {
+        NSMutableArray *queue = [self.queues objectAtIndex:index];
+        while ([queue count] > 0) {
+            DLSFTPRequestQueueEntry *entry = [queue objectAtIndex:0];
+            [queue removeObjectAtIndex:0];
+            if (entry.isRemoved == NO) {
+                DLSFTPRequest *request = entry.request;
+                [self.entries removeObjectForKey:request];
+                return request;
+            }
+        }
+    }
+    return nil;
+}
+
+- (NSArray *)removeAllRequests {
+    NSMutableArray *requests = [[NSMutableArray alloc] initWithCapacity:[self.entries count]];
+    for (NSMutableArray *queue in self.queues) {
+        for (DLSFTPRequestQueueEntry *entry in queue) {
+            if (entry.isRemoved == NO) {
+                [requests addObject:entry.request];
+            }
+        }
+        [queue removeAllObjects];
+    }
+    [self.entries removeAllObjects];
+    return requests;
+}
+
+@end
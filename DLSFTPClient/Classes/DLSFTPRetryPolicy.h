@@ -0,0 +1,59 @@
+//
+//  DLSFTPRetryPolicy.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "DLSFTP.h"
+
+// Describes when and how soon a failed request is retried.  Attach one to a
+// request's retryPolicy before submitting it.  The connection retries the
+// request in place, ahead of other requests of its priority, after a delay
+// that grows exponentially with each attempt and is randomized by jitter
+@interface DLSFTPRetryPolicy : NSObject
+
+// Total attempts, including the first.  Defaults to 3
+@property (nonatomic, assign) NSUInteger maximumAttempts;
+// Delay before the first retry, in seconds.  Defaults to 1
+@property (nonatomic, assign) NSTimeInterval initialDelay;
+// Factor the delay grows by with each retry.  Defaults to 2
+@property (nonatomic, assign) double backoffMultiplier;
+// Upper bound on the delay, in seconds.  Defaults to 30
+@property (nonatomic, assign) NSTimeInterval maximumDelay;
+// Fraction of each delay that is randomized, from 0 to 1, so that requests
+// failing together don't retry together.  Defaults to 0.5
+@property (nonatomic, assign) double jitter;
+// NSNumbers of the eSFTPClientErrorCodes worth retrying.  Defaults to failures
+// reading, writing, opening and statting files, and request timeouts
+@property (nonatomic, copy) NSSet *retryableErrorCodes;
+
+- (BOOL)shouldRetryError:(NSError *)error afterAttempt:(NSUInteger)attempt;
+- (NSTimeInterval)delayAfterAttempt:(NSUInteger)attempt;
+
+@end
@@ -0,0 +1,80 @@
+//
+//  DLSFTPRetryPolicy.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPRetryPolicy.h"
+
+static const NSUInteger cDefaultMaximumAttempts = 3;
+static const NSTimeInterval cDefaultInitialDelay = 1.0;
+static const double cDefaultBackoffMultiplier = 2.0;
+static const NSTimeInterval cDefaultMaximumDelay = 30.0;
+static const double cDefaultJitter = 0.5;
+
+@implementation DLSFTPRetryPolicy
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.maximumAttempts = cDefaultMaximumAttempts;
+        self.initialDelay = cDefaultInitialDelay;
+        self.backoffMultiplier = cDefaultBackoffMultiplier;
+        self.maximumDelay = cDefaultMaximumDelay;
+        self.jitter = cDefaultJitter;
+        self.retryableErrorCodes = [NSSet setWithObjects:
+                                    @(eSFTPClientErrorUnableToOpenFile),
+                                    @(eSFTPClientErrorUnableToReadFile),
+                                    @(eSFTPClientErrorUnableToWriteFile),
+                                    @(eSFTPClientErrorUnableToStatFile),
+                                    @(eSFTPClientErrorRequestTimedOut),
+                                    nil];
+    }
+    return self;
+}
+
+- (BOOL)shouldRetryError:(NSError *)error afterAttempt:(NSUInteger)attempt {
+    if (attempt >= self.maximumAttempts) {
+        return NO;
+    }
+    if ([[error domain] isEqualToString:SFTPClientErrorDomain] == NO) {
+        return NO;
+    }
+    return [self.retryableErrorCodes containsObject:@([error code])];
+}
+
+- (NSTimeInterval)delayAfterAttempt:(NSUInteger)attempt {
+    double exponent = attempt > 0 ? attempt - 1 : 0;
+    NSTimeInterval delay = MIN(self.initialDelay * pow(self.backoffMultiplier, exponent), self.maximumDelay);
+    double jitter = MAX(0.0, MIN(self.jitter, 1.0));
+    // remove a random part of the jittered fraction
+    double random = (double)arc4random_uniform(UINT32_MAX) / UINT32_MAX;
+    return delay * (1.0 - jitter * random);
+}
+
+@end
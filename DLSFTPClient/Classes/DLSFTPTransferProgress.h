@@ -0,0 +1,61 @@
+//
+//  DLSFTPTransferProgress.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+// A snapshot of a transfer's progress, passed to transfer progress blocks
+@interface DLSFTPTransferProgress : NSObject
+
+- (id)initWithBytesTransferred:(unsigned long long)bytesTransferred
+                    bytesTotal:(unsigned long long)bytesTotal
+             instantaneousRate:(double)instantaneousRate
+                  averageRate:(double)averageRate;
+
+- (id)initWithBytesTransferred:(unsigned long long)bytesTransferred
+                    bytesTotal:(unsigned long long)bytesTotal
+             instantaneousRate:(double)instantaneousRate
+                  averageRate:(double)averageRate
+                      finished:(BOOL)finished;
+
+@property (nonatomic, readonly) unsigned long long bytesTransferred;
+// 0 if unknown, as for uploads from a stream
+@property (nonatomic, readonly) unsigned long long bytesTotal;
+// bytes per second since the previous report
+@property (nonatomic, readonly) double instantaneousRate;
+// bytes per second, exponentially smoothed over the reports so far
+@property (nonatomic, readonly) double averageRate;
+// YES for the report made once the transfer has stopped
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+// seconds remaining at the average rate, or a negative value if unknown,
+// which it always is while bytesTotal is 0
+@property (nonatomic, readonly) NSTimeInterval estimatedTimeRemaining;
+
+@end
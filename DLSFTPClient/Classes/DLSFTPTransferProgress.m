@@ -0,0 +1,96 @@
+//
+//  DLSFTPTransferProgress.m
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  Redistributions of source code must retain the above copyright notice,
+//  this list of conditions and the following disclaimer.
+//
+//  Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DLSFTPTransferProgress.h"
+
+@interface DLSFTPTransferProgress ()
+
+@property (nonatomic, readwrite) unsigned long long bytesTransferred;
+@property (nonatomic, readwrite) unsigned long long bytesTotal;
+@property (nonatomic, readwrite) double instantaneousRate;
+@property (nonatomic, readwrite) double averageRate;
+@property (nonatomic, readwrite, getter = isFinished) BOOL finished;
+
+@end
+
+@implementation DLSFTPTransferProgress
+
+- (id)initWithBytesTransferred:(unsigned long long)bytesTransferred
+                    bytesTotal:(unsigned long long)bytesTotal
+             instantaneousRate:(double)instantaneousRate
+                  averageRate:(double)averageRate {
+    return [self initWithBytesTransferred:bytesTransferred
+                               bytesTotal:bytesTotal
+                        instantaneousRate:instantaneousRate
+                              averageRate:averageRate
+                                 finished:NO];
+}
+
+- (id)initWithBytesTransferred:(unsigned long long)bytesTransferred
+                    bytesTotal:(unsigned long long)bytesTotal
+             instantaneousRate:(double)instantaneousRate
+                  averageRate:(double)averageRate
+                      finished:(BOOL)finished {
+    self = [super init];
+    if (self) {
+        self.bytesTransferred = bytesTransferred;
+        self.bytesTotal = bytesTotal;
+        self.instantaneousRate = instantaneousRate;
+        self.averageRate = averageRate;
+        self.finished = finished;
+    }
+    return self;
+}
+
+- (NSTimeInterval)estimatedTimeRemaining {
+    if (self.bytesTotal == 0) {
+        // unknown total, or a zero-length file, only known to be done once finished
+        return self.isFinished ? 0.0 : -1.0;
+    }
+    if (self.bytesTransferred >= self.bytesTotal) {
+        return 0.0;
+    }
+    if (self.averageRate <= 0.0) {
+        return -1.0;
+    }
+    return (self.bytesTotal - self.bytesTransferred) / self.averageRate;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %llu of %llu bytes, %.0f bytes/sec, %.1f sec remaining>"
+            , NSStringFromClass([self class])
+            , self.bytesTransferred
+            , self.bytesTotal
+            , self.averageRate
+            , self.estimatedTimeRemaining];
+}
+
+@end
@@ -38,4 +38,52 @@
             failureBlock:(DLSFTPClientFailureBlock)failureBlock
            progressBlock:(DLSFTPClientProgressBlock)progressBlock;
 
+// If resumeIfFileExists, an existing remote file no longer than the local file
+// is taken to be an interrupted upload, and the rest of the local file is
+// appended to it.  Otherwise the remote file is replaced.  Requests retried by
+// their retryPolicy always resume
+- (id)initWithRemotePath:(NSString *)remotePath
+               localPath:(NSString *)localPath
+                  resume:(BOOL)resumeIfFileExists
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+// When resuming, the number of bytes before the resume point that are read
+// back from the server and compared with the local file.  If they differ, the
+// remote file is truncated and uploaded from the start.  If they can't be
+// read, the request fails with eSFTPClientErrorUnableToReadFile and the remote
+// file is kept.  Defaults to 0, which trusts the remote file's size
+@property (nonatomic, assign) NSUInteger resumeVerificationLength;
+
+// Writes the upload to a hidden sibling of remotePath, and renames it over
+// remotePath once complete, so readers never see a partial file.  An existing
+// remotePath is moved aside while it is replaced, so it may briefly be missing,
+// and is restored if the rename fails.  An interrupted upload leaves the
+// sibling, which a resumed upload continues.  Defaults to NO
+@property (nonatomic, assign) BOOL uploadsAtomically;
+
+// Upload from memory, without a temporary file.  Immutable data is not copied,
+// mutable data is copied once so later changes don't affect the upload
+- (id)initWithRemotePath:(NSString *)remotePath
+                    data:(NSData *)data
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+- (id)initWithRemotePath:(NSString *)remotePath
+            dispatchData:(dispatch_data_t)data
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
+// Upload from a stream of unknown length, read until it ends.  The stream is
+// opened if needed and read on a private queue, so reads may block.  Progress
+// is reported with a bytesTotal of 0, and the request is never retried
+- (id)initWithRemotePath:(NSString *)remotePath
+             inputStream:(NSInputStream *)inputStream
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock;
+
 @end
@@ -33,8 +33,8 @@
 #import "DLSFTPConnection.h"
 #import "DLSFTPFile.h"
 #import "NSDictionary+SFTPFileAttributes.h"
-
-static const size_t cBufferSize = 8192;
+#import "DLSFTPProgressReporter.h"
+#import "DLSFTPHasher.h"
 
 @interface DLSFTPUploadRequest ()
 
@@ -50,13 +50,37 @@ static const size_t cBufferSize = 8192;
 @property (nonatomic) int read_error;
 
 @property (nonatomic, assign) LIBSSH2_SFTP_HANDLE *handle;
+@property (nonatomic, strong) DLSFTPProgressReporter *progressReporter;
+@property (nonatomic, strong) DLSFTPHasher *hasher;
+
+// the source when not uploading from localPath
+@property (nonatomic) dispatch_data_t sourceData;
+@property (nonatomic, strong) NSInputStream *inputStream;
+@property (nonatomic) dispatch_queue_t streamQueue; // inputStream is read on this queue
 
 @end
 
 @implementation DLSFTPUploadRequest
 
+@synthesize sourceData=_sourceData;
+@synthesize streamQueue=_streamQueue;
+
+- (id)initWithRemotePath:(NSString *)remotePath
+               localPath:(NSString *)localPath
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    return [self initWithRemotePath:remotePath
+                          localPath:localPath
+                             resume:NO
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+}
+
 - (id)initWithRemotePath:(NSString *)remotePath
                localPath:(NSString *)localPath
+                  resume:(BOOL)resumeIfFileExists
             successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
             failureBlock:(DLSFTPClientFailureBlock)failureBlock
            progressBlock:(DLSFTPClientProgressBlock)progressBlock {
@@ -64,6 +88,7 @@ static const size_t cBufferSize = 8192;
     if (self) {
         self.remotePath = remotePath;
         self.localPath = localPath;
+        self.shouldResume = resumeIfFileExists;
         self.successBlock = successBlock;
         self.failureBlock = failureBlock;
         self.progressBlock = progressBlock;
@@ -71,14 +96,107 @@ static const size_t cBufferSize = 8192;
     return self;
 }
 
+- (id)initWithRemotePath:(NSString *)remotePath
+                    data:(NSData *)data
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    // an immutable copy, which the dispatch data keeps alive instead of copying its bytes
+    NSData *sourceData = [data copy];
+    dispatch_data_t dispatchData = dispatch_data_create(  [sourceData bytes]
+                                                        , [sourceData length]
+                                                        , dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)
+                                                        , ^{ (void)sourceData; });
+    self = [self initWithRemotePath:remotePath
+                       dispatchData:dispatchData
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(dispatchData);
+#endif
+    return self;
+}
+
+- (id)initWithRemotePath:(NSString *)remotePath
+            dispatchData:(dispatch_data_t)data
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    self = [self initWithRemotePath:remotePath
+                          localPath:nil
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+    if (self) {
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_retain(data);
+#endif
+        self.sourceData = data;
+    }
+    return self;
+}
+
+- (id)initWithRemotePath:(NSString *)remotePath
+             inputStream:(NSInputStream *)inputStream
+            successBlock:(DLSFTPClientFileTransferSuccessBlock)successBlock
+            failureBlock:(DLSFTPClientFailureBlock)failureBlock
+           progressBlock:(DLSFTPClientProgressBlock)progressBlock {
+    self = [self initWithRemotePath:remotePath
+                          localPath:nil
+                       successBlock:successBlock
+                       failureBlock:failureBlock
+                      progressBlock:progressBlock];
+    if (self) {
+        self.inputStream = inputStream;
+    }
+    return self;
+}
+
+- (void)dealloc {
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    if (_sourceData) {
+        dispatch_release(_sourceData);
+        _sourceData = NULL;
+    }
+    if (_streamQueue) {
+        dispatch_release(_streamQueue);
+        _streamQueue = NULL;
+    }
+#endif
+}
+
+- (BOOL)isPreemptible {
+    return YES;
+}
+
+- (BOOL)shouldRetry {
+    // a stream can't be read again
+    return self.inputStream == nil && [super shouldRetry];
+}
+
+- (void)prepareForRetry {
+    [super prepareForRetry];
+    // continue from the data already uploaded
+    self.shouldResume = YES;
+}
+
+// where the data is written, a hidden sibling of remotePath if uploading atomically
+- (NSString *)uploadPath {
+    if (self.uploadsAtomically == NO) {
+        return self.remotePath;
+    }
+    return [self hiddenSiblingPathWithSuffix:@"part"];
+}
+
 - (BOOL)openFileHandle {
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
     int socketFD = [self.connection socket];
     LIBSSH2_SFTP_HANDLE *handle = NULL;
     while (   (handle = libssh2_sftp_open(  sftp
-                                          , [self.remotePath UTF8String]
-                                          , LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_READ
+                                          , [[self uploadPath] UTF8String]
+                                          , LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_READ|(self.shouldResume ? 0 : LIBSSH2_FXF_TRUNC)
                                           , LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|
                                           LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH)) == NULL
            && (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
@@ -88,7 +206,7 @@ static const size_t cBufferSize = 8192;
     self.handle = handle;
     if (handle == NULL) {
         // unable to open
-        unsigned long lastError = libssh2_sftp_last_error([self.connection sftp]);
+        unsigned long lastError = libssh2_sftp_last_error(self.sftp);
         NSString *errorDescription = [NSString stringWithFormat:@"Unable to open file for writing: SFTP Status Code %ld", lastError];
         self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenFile
                         errorDescription:errorDescription
@@ -100,126 +218,421 @@ static const size_t cBufferSize = 8192;
 }
 
 - (void)start {
-    if (   [self pathIsValid:self.localPath] == NO
-        || [self pathIsValid:self.remotePath] == NO
+    if (   [self pathIsValid:self.remotePath] == NO
         || [self ready] == NO
         || [self checkSftp] == NO) {
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
-    // verify local file is readable prior to upload
-    if ([[NSFileManager defaultManager] isReadableFileAtPath:self.localPath] == NO) {
-        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
-                        errorDescription:@"Local file is not readable"
-                         underlyingError:nil];
+    unsigned long long bytesTotal = 0ull; // unknown for streams
+    if (self.localPath) {
+        if ([self pathIsValid:self.localPath] == NO) {
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+        // verify local file is readable prior to upload
+        if ([[NSFileManager defaultManager] isReadableFileAtPath:self.localPath] == NO) {
+            self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
+                            errorDescription:@"Local file is not readable"
+                             underlyingError:nil];
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+
+        NSError __autoreleasing *attributesError = nil;
+        NSDictionary *localFileAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:self.localPath
+                                                                                             error:&attributesError];
+        if (localFileAttributes == nil) {
+            self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
+                            errorDescription:@"Unable to get attributes of Local file"
+                             underlyingError:@(attributesError.code)];
+            [self.connection requestDidFail:self withError:self.error];
+            return;
+        }
+        bytesTotal = [localFileAttributes fileSize];
+    } else if (self.sourceData) {
+        bytesTotal = dispatch_data_get_size(self.sourceData);
+    }
+
+    if ([self openFileHandle] == NO) {
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
-
-    NSError __autoreleasing *attributesError = nil;
-    NSDictionary *localFileAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:self.localPath
-                                                                                         error:&attributesError];
-    if (localFileAttributes == nil) {
-        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
-                        errorDescription:@"Unable to get attributes of Local file"
-                         underlyingError:@(attributesError.code)];
+    unsigned long long resumeOffset = 0ull;
+    if (   self.shouldResume
+        && self.inputStream == nil
+        && [self findResumeOffset:&resumeOffset localSize:bytesTotal] == NO) {
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
-
-    LIBSSH2_SESSION *session = [self.connection session];
-    int socketFD = [self.connection socket];
-
-    if ([self openFileHandle] == NO) {
+    if ([self prepareHasherFromOffset:resumeOffset] == NO) {
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
+    self.progressReporter = [[DLSFTPProgressReporter alloc] initWithQueue:[self targetCallbackQueue]
+                                                               bytesTotal:bytesTotal
+                                                             initialBytes:resumeOffset
+                                                                 interval:self.progressInterval
+                                                              granularity:self.progressGranularity
+                                                            progressBlock:self.progressBlock
+                                                    transferProgressBlock:self.transferProgressBlock];
+    self.startTime = [NSDate date];
+    self.read_error = 0;
+    self.sftp_result = 0;
+
+    __weak DLSFTPUploadRequest *weakSelf = self;
+    if (self.sourceData) {
+        dispatch_async(self.connection.socketQueue, ^{ [weakSelf uploadSourceDataFromOffset:(size_t)resumeOffset]; });
+    } else if (self.inputStream) {
+        if (self.streamQueue == NULL) {
+            self.streamQueue = dispatch_queue_create("com.hammockdistrict.SFTPClient.stream", DISPATCH_QUEUE_SERIAL);
+        }
+        dispatch_async(self.streamQueue, ^{
+            if ([weakSelf.inputStream streamStatus] == NSStreamStatusNotOpen) {
+                [weakSelf.inputStream open];
+            }
+            [weakSelf readInputStream];
+        });
+    } else {
+        [self uploadLocalFileFromOffset:(off_t)resumeOffset];
+    }
+}
+
+- (void)uploadLocalFileFromOffset:(off_t)offset {
     __weak DLSFTPUploadRequest *weakSelf = self;
     dispatch_queue_t socketQueue = self.connection.socketQueue;
+    size_t bufferSize = self.connection.transferBufferSize;
+    NSString *localPath = self.localPath;
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        // opened here rather than by the channel, so a stream channel starts at offset
+        int fd = open([localPath fileSystemRepresentation], O_RDONLY);
+        if (fd < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+            int openError = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+            dispatch_async(socketQueue, ^{
+                weakSelf.read_error = openError;
+                [weakSelf uploadFinished];
+            });
+            return;
+        }
+        // the handler is invoked once more after the channel is stopped.  Both
+        // handlers run on the socket queue
+        __block BOOL stopped = NO;
         void(^cleanup_handler)(int) = ^(int error) {
-            if (error) {
-                printf("Error creating channel: %d", error);
+            close(fd);
+            if (error && stopped == NO) {
+                // the channel failed before reading finished
+                stopped = YES;
+                weakSelf.read_error = error;
+                [weakSelf uploadFinished];
             }
         };
 
-        dispatch_io_t channel = dispatch_io_create_with_path(  DISPATCH_IO_STREAM
-                                                             , [weakSelf.localPath UTF8String]
-                                                             , O_RDONLY
-                                                             , 0
-                                                             , socketQueue
-                                                             , cleanup_handler
-                                                             );
-        dispatch_source_t progressSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
-        __block unsigned long long totalBytesSent = 0ull;
-        unsigned long long filesize = [localFileAttributes fileSize];
-        DLSFTPClientProgressBlock progressBlock = weakSelf.progressBlock;
-        dispatch_source_set_event_handler(progressSource, ^{
-            totalBytesSent += dispatch_source_get_data(progressSource);
-            if (progressBlock) {
-                progressBlock(totalBytesSent, filesize);
-            }
-        });
-
-        dispatch_source_set_cancel_handler(progressSource, ^{
-#if NEEDS_DISPATCH_RETAIN_RELEASE
-            dispatch_release(progressSource);
-#endif
-        });
-        dispatch_resume(progressSource);
-
-        weakSelf.startTime = [NSDate date];
-        weakSelf.read_error = 0;
+        dispatch_io_t channel = dispatch_io_create(  DISPATCH_IO_STREAM
+                                                   , fd
+                                                   , socketQueue
+                                                   , cleanup_handler
+                                                   );
+        if (channel == NULL) {
+            // the cleanup handler won't be called
+            int channelError = errno ? errno : EINVAL;
+            close(fd);
+            dispatch_async(socketQueue, ^{
+                weakSelf.read_error = channelError;
+                [weakSelf uploadFinished];
+            });
+            return;
+        }
 
         // set the high watermark to the buffer size
-        dispatch_io_set_high_water(channel, cBufferSize);
+        dispatch_io_set_high_water(channel, bufferSize);
 
         dispatch_io_read(  channel
                          , 0 // for stream, offset is ignored
                          , SIZE_MAX
                          , socketQueue // blocks with data queued on the socket queue
                          , ^(bool done, dispatch_data_t data, int error) {
-                             // data objects will be less than or equal to the buffer size
-                             if (done || weakSelf.isCancelled) {
-                                 if(dispatch_source_testcancel(progressSource) == 0) {
-                                     dispatch_source_cancel(progressSource);
-                                 }
-                                 dispatch_io_close(channel, weakSelf.isCancelled ? DISPATCH_IO_STOP : 0);
-                                 dispatch_async(socketQueue, ^{ [weakSelf uploadFinished]; });
+                             if (stopped) {
                                  return;
                              }
-                             dispatch_data_applier_t applier = ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
-                                 // send the buffer
-                                 size_t sftp_result = 0;
-                                 while (   weakSelf.isCancelled == NO
-                                        && (sftp_result = libssh2_sftp_write(weakSelf.handle, buffer + offset, size)) == LIBSSH2SFTP_EAGAIN) {
-                                     // update shouldcontinue into the waitsocket file desctiptor
-                                     waitsocket(socketFD, session);
-                                 }
-                                 weakSelf.sftp_result = sftp_result;
-                                 if (sftp_result > 0) {
-                                     dispatch_source_merge_data(progressSource, sftp_result);
-                                     return true;
-                                 } else if (sftp_result == 0) {
-                                     // nothing written
-                                     return true;
-                                 } else {
-                                     // error in SFTP write
-                                     return false;
-                                 }
-                             };
-                             dispatch_data_apply(data, applier);
-                             // end of reading while loop in dispatch_io_handler
                              weakSelf.read_error = error;
+                             // data objects will be less than or equal to the buffer size, and the last may come with done
+                             BOOL written = weakSelf.isCancelled == NO && (data == NULL || [weakSelf writeData:data]);
+                             if (done || written == NO) {
+                                 stopped = YES;
+                                 dispatch_io_close(channel, written ? 0 : DISPATCH_IO_STOP);
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+                                 dispatch_release(channel);
+#endif
+                                 [weakSelf uploadFinished];
+                             }
                          }); // end of dispatch_io_read
     });
 }
 
+// Starts the hash, over the data already on the server when resuming, so the
+// digest covers the whole file
+- (BOOL)prepareHasherFromOffset:(unsigned long long)resumeOffset {
+    if (self.hashAlgorithm == eSFTPClientHashAlgorithmNone) {
+        self.hasher = nil;
+        return YES;
+    }
+    DLSFTPHasher *hasher = [[DLSFTPHasher alloc] initWithAlgorithm:self.hashAlgorithm];
+    BOOL hashed = (hasher != nil);
+    if (hashed && resumeOffset > 0) {
+        if (self.sourceData) {
+            dispatch_data_t prefix = dispatch_data_create_subrange(self.sourceData, 0, (size_t)resumeOffset);
+            [hasher updateWithData:prefix];
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+            dispatch_release(prefix);
+#endif
+        } else {
+            hashed = [hasher updateWithContentsOfFile:self.localPath length:resumeOffset];
+        }
+    }
+    if (hashed == NO) {
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToOpenLocalFileForReading
+                        errorDescription:@"Unable to hash the data already uploaded"
+                         underlyingError:nil];
+        return NO;
+    }
+    self.hasher = hasher;
+    return YES;
+}
+
+// Called on the socket queue with the remote handle open.  Resumes after the
+// data already on the server, or from the start if the server holds more
+// than the local file or its last resumeVerificationLength bytes differ
+- (BOOL)findResumeOffset:(unsigned long long *)resumeOffset localSize:(unsigned long long)localSize {
+    int socketFD = [self.connection socket];
+    LIBSSH2_SESSION *session = [self.connection session];
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    int result;
+    while (  ((result = libssh2_sftp_fstat(self.handle, &attributes)) == LIBSSH2SFTP_EAGAIN)
+           && self.isCancelled == NO) {
+        waitsocket(socketFD, session);
+    }
+    if ([self ready] == NO) {
+        return NO;
+    }
+    if (result) {
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to stat file: SFTP Status Code %d", result];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToStatFile
+                        errorDescription:errorDescription
+                         underlyingError:@(result)];
+        return NO;
+    }
+    unsigned long long remoteSize = attributes.filesize;
+    if (remoteSize <= localSize) {
+        // truncate only if the bytes were compared, a failed read fails the request
+        BOOL matches = NO;
+        if ([self compareRemoteFileBefore:remoteSize matches:&matches] == NO) {
+            return NO;
+        }
+        if (matches) {
+            *resumeOffset = remoteSize;
+            libssh2_sftp_seek64(self.handle, remoteSize);
+            return YES;
+        }
+    }
+    // start over, truncating what is there
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.flags = LIBSSH2_SFTP_ATTR_SIZE;
+    attributes.filesize = 0;
+    while (  ((result = libssh2_sftp_fsetstat(self.handle, &attributes)) == LIBSSH2SFTP_EAGAIN)
+           && self.isCancelled == NO) {
+        waitsocket(socketFD, session);
+    }
+    if ([self ready] == NO) {
+        return NO;
+    }
+    if (result) {
+        unsigned long lastError = libssh2_sftp_last_error(self.sftp);
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to truncate file: SFTP Status Code %ld", lastError];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToWriteFile
+                        errorDescription:errorDescription
+                         underlyingError:@(lastError)];
+        return NO;
+    }
+    libssh2_sftp_seek64(self.handle, 0);
+    *resumeOffset = 0ull;
+    return YES;
+}
+
+// Compares the resumeVerificationLength bytes before resumeOffset on the
+// server with the source, setting matches.  Returns NO and sets error if
+// either side could not be read in full, leaving matches unset
+- (BOOL)compareRemoteFileBefore:(unsigned long long)resumeOffset matches:(BOOL *)matches {
+    size_t length = (size_t)MIN((unsigned long long)self.resumeVerificationLength, resumeOffset);
+    if (length == 0) {
+        *matches = YES;
+        return YES;
+    }
+    unsigned long long tailOffset = resumeOffset - length;
+    NSData *localTail = nil;
+    if (self.sourceData) {
+        NSMutableData *data = [NSMutableData dataWithCapacity:length];
+        dispatch_data_t tail = dispatch_data_create_subrange(self.sourceData, (size_t)tailOffset, length);
+        dispatch_data_apply(tail, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+            [data appendBytes:buffer length:size];
+            return true;
+        });
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(tail);
+#endif
+        localTail = data;
+    } else {
+        NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:self.localPath];
+        [fileHandle seekToFileOffset:tailOffset];
+        localTail = [fileHandle readDataOfLength:length];
+        [fileHandle closeFile];
+    }
+    if ([localTail length] != length) {
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to read %@ to verify resuming", self.localPath];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToReadFile
+                        errorDescription:errorDescription
+                         underlyingError:nil];
+        return NO;
+    }
+
+    int socketFD = [self.connection socket];
+    LIBSSH2_SESSION *session = [self.connection session];
+    NSMutableData *remoteTail = [NSMutableData dataWithLength:length];
+    char *buffer = [remoteTail mutableBytes];
+    size_t bytesRead = 0;
+    libssh2_sftp_seek64(self.handle, tailOffset);
+    while (bytesRead < length) {
+        ssize_t result = 0;
+        while (   self.isCancelled == NO
+               && (result = libssh2_sftp_read(self.handle, buffer + bytesRead, length - bytesRead)) == LIBSSH2SFTP_EAGAIN) {
+            waitsocket(socketFD, session);
+        }
+        if ([self ready] == NO) {
+            return NO;
+        }
+        if (result <= 0) {
+            // an error, or the file shrank since it was stat'd
+            unsigned long lastError = result < 0 ? libssh2_sftp_last_error(self.sftp) : 0;
+            NSString *errorDescription = [NSString stringWithFormat:@"Unable to read %@ to verify resuming: SFTP Status Code %ld", self.remotePath, lastError];
+            self.error = [self errorWithCode:eSFTPClientErrorUnableToReadFile
+                            errorDescription:errorDescription
+                             underlyingError:@(lastError)];
+            return NO;
+        }
+        bytesRead += result;
+    }
+    *matches = [remoteTail isEqualToData:localTail];
+    return YES;
+}
+
+// called on the socket queue to upload the chunk of sourceData at offset,
+// yielding the queue before the next
+- (void)uploadSourceDataFromOffset:(size_t)offset {
+    size_t size = dispatch_data_get_size(self.sourceData);
+    size_t length = MIN(self.connection.transferBufferSize, size - offset);
+    if (length == 0 || self.isCancelled) {
+        [self uploadFinished];
+        return;
+    }
+    // subranges share the source's buffers rather than copying them
+    dispatch_data_t data = dispatch_data_create_subrange(self.sourceData, offset, length);
+    BOOL written = [self writeData:data];
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+    dispatch_release(data);
+#endif
+    if (written == NO) {
+        [self uploadFinished];
+        return;
+    }
+    __weak DLSFTPUploadRequest *weakSelf = self;
+    dispatch_async(self.connection.socketQueue, ^{ [weakSelf uploadSourceDataFromOffset:offset + length]; });
+}
+
+// called on streamQueue to read the next chunk of inputStream, which is then
+// written on the socket queue.  Reads may block, so they stay off the socket queue
+- (void)readInputStream {
+    dispatch_queue_t socketQueue = self.connection.socketQueue;
+    if (socketQueue == NULL) {
+        return;
+    }
+    __weak DLSFTPUploadRequest *weakSelf = self;
+    size_t bufferSize = self.connection.transferBufferSize;
+    uint8_t *buffer = malloc(sizeof(uint8_t) * bufferSize);
+    NSInteger bytesRead = self.isCancelled ? 0 : [self.inputStream read:buffer maxLength:bufferSize];
+    if (bytesRead <= 0) {
+        free(buffer);
+        if (bytesRead < 0) {
+            NSInteger code = [[self.inputStream streamError] code];
+            self.read_error = code ? (int)code : -1;
+        }
+        dispatch_async(socketQueue, ^{ [weakSelf uploadFinished]; });
+        return;
+    }
+    dispatch_data_t data = dispatch_data_create(buffer, bytesRead, NULL, DISPATCH_DATA_DESTRUCTOR_FREE);
+    dispatch_async(socketQueue, ^{
+        DLSFTPUploadRequest *strongSelf = weakSelf;
+        BOOL written = [strongSelf writeData:data];
+#if NEEDS_DISPATCH_RETAIN_RELEASE
+        dispatch_release(data);
+#endif
+        if (written) {
+            dispatch_async(strongSelf.streamQueue, ^{ [weakSelf readInputStream]; });
+        } else {
+            [strongSelf uploadFinished];
+        }
+    });
+}
+
+// Called on the socket queue to send data, in as many writes as libssh2 takes.
+// Returns NO if the request is cancelled or a write fails, leaving the result
+// of the failed write in sftp_result, or -1 and self.error if nothing was written
+- (BOOL)writeData:(dispatch_data_t)data {
+    int socketFD = [self.connection socket];
+    LIBSSH2_SESSION *session = [self.connection session];
+    __block BOOL written = YES;
+    dispatch_data_apply(data, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        // buffer is the region's own, offset is the region's position in data
+        size_t regionWritten = 0;
+        while (regionWritten < size) {
+            ssize_t sftp_result = 0;
+            while (   self.isCancelled == NO
+                   && (sftp_result = libssh2_sftp_write(self.handle, (const char *)buffer + regionWritten, size - regionWritten)) == LIBSSH2SFTP_EAGAIN) {
+                // update shouldcontinue into the waitsocket file desctiptor
+                waitsocket(socketFD, session);
+            }
+            self.sftp_result = (int)sftp_result;
+            if (self.isCancelled || sftp_result < 0) {
+                // error in SFTP write
+                written = NO;
+                return false;
+            } else if (sftp_result == 0) {
+                // libssh2 only returns 0 for an empty write, so the rest of the region would be lost
+                self.sftp_result = -1;
+                self.error = [self errorWithCode:eSFTPClientErrorUnableToWriteFile
+                                errorDescription:@"Write file failed: no data was written"
+                                 underlyingError:nil];
+                written = NO;
+                return false;
+            }
+            [self.hasher updateWithBytes:(const char *)buffer + regionWritten length:sftp_result];
+            regionWritten += sftp_result;
+            [self noteActivity];
+            [self.progressReporter addBytes:sftp_result];
+        }
+        return true;
+    });
+    return written;
+}
+
 - (void)uploadFinished {
     self.finishTime = [NSDate date];
+    [self.progressReporter finish];
+    [self.inputStream close];
     int socketFD = [self.connection socket];
     LIBSSH2_SESSION *session = [self.connection session];
-    LIBSSH2_SFTP *sftp = [self.connection sftp];
+    LIBSSH2_SFTP *sftp = self.sftp;
 
     if (self.isCancelled) {
         // Cancelled by user
@@ -230,9 +643,7 @@ static const size_t cBufferSize = 8192;
             self.handle = NULL;
         }
         // delete remote file on cancel?
-        self.error = [self errorWithCode:eSFTPClientErrorCancelledByUser
-                        errorDescription:@"Cancelled by user."
-                         underlyingError:nil];
+        self.error = [self cancellationError];
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
@@ -261,11 +672,13 @@ static const size_t cBufferSize = 8192;
             [self.connection requestDidFail:self withError:self.error];
             return;
         }
-        // error writing
-        NSString *errorDescription = [NSString stringWithFormat:@"Write file failed with code %lu.", result];
-        self.error = [self errorWithCode:eSFTPClientErrorUnableToWriteFile
-                        errorDescription:errorDescription
-                         underlyingError:@(result)];
+        // error writing, unless writeData: already described it
+        if (self.error == nil) {
+            NSString *errorDescription = [NSString stringWithFormat:@"Write file failed with code %lu.", result];
+            self.error = [self errorWithCode:eSFTPClientErrorUnableToWriteFile
+                            errorDescription:errorDescription
+                             underlyingError:@(result)];
+        }
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
@@ -310,23 +723,136 @@ static const size_t cBufferSize = 8192;
         [self.connection requestDidFail:self withError:self.error];
         return;
     }
+    if (self.uploadsAtomically && [self renameIntoPlace] == NO) {
+        [self.connection requestDidFail:self withError:self.error];
+        return;
+    }
 
     NSDictionary *attributesDictionary = [NSDictionary dictionaryWithAttributes:attributes];
     DLSFTPFile *file = [[DLSFTPFile alloc] initWithPath:self.remotePath
-                                             attributes:attributesDictionary];
+                                             attributes:attributesDictionary
+                                                 digest:[self.hasher finish]];
+    self.hasher = nil;
     self.uploadedFile = file;
     [self.connection requestDidComplete:self];
 }
 
+// sibling of remotePath with the given suffix, hidden
+- (NSString *)hiddenSiblingPathWithSuffix:(NSString *)suffix {
+    NSString *name = [NSString stringWithFormat:@".%@.%@", [self.remotePath lastPathComponent], suffix];
+    return [[self.remotePath stringByDeletingLastPathComponent] stringByAppendingPathComponent:name];
+}
+
+// where the original remotePath is kept while the upload replaces it
+- (NSString *)backupPath {
+    return [self hiddenSiblingPathWithSuffix:@"orig"];
+}
+
+// libssh2_sftp_rename includes overwrite | atomic | native.  Returns 0 or a libssh2 error
+- (int)renamePath:(const char *)sourcePath toPath:(const char *)destinationPath {
+    LIBSSH2_SESSION *session = [self.connection session];
+    LIBSSH2_SFTP *sftp = self.sftp;
+    int socketFD = [self.connection socket];
+    int result;
+    while(  ((result = libssh2_sftp_rename(sftp, sourcePath, destinationPath)) == LIBSSH2SFTP_EAGAIN)
+          && self.isCancelled == NO) {
+        waitsocket(socketFD, session);
+    }
+    return result;
+}
+
+// removes path if it exists, ignoring errors
+- (void)unlinkPath:(const char *)path {
+    LIBSSH2_SESSION *session = [self.connection session];
+    int socketFD = [self.connection socket];
+    while(  (libssh2_sftp_unlink(self.sftp, path) == LIBSSH2SFTP_EAGAIN)
+          && self.isCancelled == NO) {
+        waitsocket(socketFD, session);
+    }
+}
+
+// YES if the rename failed because its destination exists.  OpenSSH reports
+// every rename error as FX_FAILURE, so that is only taken to mean the target
+// exists when an lstat finds it
+- (BOOL)renameFailedOnExistingPath:(const char *)path result:(int)result {
+    if (result != LIBSSH2_ERROR_SFTP_PROTOCOL || self.isCancelled) {
+        return NO;
+    }
+    LIBSSH2_SFTP *sftp = self.sftp;
+    unsigned long renameError = libssh2_sftp_last_error(sftp);
+    if (renameError == LIBSSH2_FX_FILE_ALREADY_EXISTS) {
+        return YES;
+    }
+    if (renameError != LIBSSH2_FX_FAILURE) {
+        return NO;
+    }
+    LIBSSH2_SESSION *session = [self.connection session];
+    int socketFD = [self.connection socket];
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    int statResult;
+    while(  ((statResult = libssh2_sftp_lstat(sftp, path, &attributes)) == LIBSSH2SFTP_EAGAIN)
+          && self.isCancelled == NO) {
+        waitsocket(socketFD, session);
+    }
+    return statResult == 0;
+}
+
+// Moves the finished upload over remotePath.  SFTP v3 servers refuse to
+// rename over an existing file, and libssh2 1.10 has no posix-rename, so the
+// existing file is first renamed to a backup, replacing any stale one, which
+// is restored if the upload can't be moved into place and removed once it has.  Readers may briefly find
+// remotePath missing, but never partial, and the original is never lost
+- (BOOL)renameIntoPlace {
+    LIBSSH2_SESSION *session = [self.connection session];
+    LIBSSH2_SFTP *sftp = self.sftp;
+    int socketFD = [self.connection socket];
+    const char *uploadPath = [[self uploadPath] UTF8String];
+    const char *remotePath = [self.remotePath UTF8String];
+    const char *backupPath = [[self backupPath] UTF8String];
+    int result = [self renamePath:uploadPath toPath:remotePath];
+    unsigned long lastError = libssh2_sftp_last_error(sftp);
+    if ([self renameFailedOnExistingPath:remotePath result:result]) {
+        // a backup left by a crash, or by a failed unlink below, would make
+        // the rename aside fail on SFTP v3 servers
+        [self unlinkPath:backupPath];
+        result = [self renamePath:remotePath toPath:backupPath];
+        lastError = libssh2_sftp_last_error(sftp);
+        if (result == 0) {
+            result = [self renamePath:uploadPath toPath:remotePath];
+            lastError = libssh2_sftp_last_error(sftp);
+            if (result == 0) {
+                // if this fails, the next upload to remotePath removes the backup
+                [self unlinkPath:backupPath];
+            } else {
+                // put the original back, even if cancelled
+                while (libssh2_sftp_rename(sftp, backupPath, remotePath) == LIBSSH2SFTP_EAGAIN) {
+                    waitsocket(socketFD, session);
+                }
+            }
+        }
+    }
+    if ([self ready] == NO) {
+        return NO;
+    }
+    if (result) {
+        NSString *errorDescription = [NSString stringWithFormat:@"Unable to rename uploaded file into place: SFTP Status Code %ld", lastError];
+        self.error = [self errorWithCode:eSFTPClientErrorUnableToRename
+                        errorDescription:errorDescription
+                         underlyingError:@(lastError)];
+        return NO;
+    }
+    return YES;
+}
+
 - (void)succeed {
     DLSFTPClientFileTransferSuccessBlock successBlock = self.successBlock;
     DLSFTPFile *uploadedFile = self.uploadedFile;
     NSDate *startTime = self.startTime;
     NSDate *finishTime = self.finishTime;
     if (successBlock) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self dispatchCallback:^{
             successBlock(uploadedFile,startTime,finishTime);
-        });
+        }];
     }
     self.successBlock = nil;
     self.failureBlock = nil;
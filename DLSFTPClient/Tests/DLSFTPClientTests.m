@@ -38,8 +38,10 @@
 #import "DLSFTPRemoveDirectoryRequest.h"
 #import "DLSFTPUploadRequest.h"
 #import "DLSFTPDownloadRequest.h"
+#import "DLSFTPHasher.h"
 #import "DLSFTPMoveRenameRequest.h"
 #import "DLSFTPRemoveFileRequest.h"
+#import "DLSFTPBatchRequest.h"
 
 @interface DLSFTPClientTests ()
 
@@ -492,4 +494,857 @@
     STAssertNil(localError, localError.localizedDescription);
 }
 
+#if DLSFTPCLIENT_BENCHMARKS
+// Benchmark: downloads a generated file at several window and buffer sizes and logs the throughput of each.
+// It asserts nothing about behaviour and takes minutes, so it only builds with DLSFTPCLIENT_BENCHMARKS=1
+// added to the test target's preprocessor macros
+- (void)test12TransferTuningThroughput {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    // generate a file large enough for the window to matter
+    const NSUInteger benchmarkFileSize = 16 * 1024 * 1024;
+    NSMutableData *benchmarkData = [NSMutableData dataWithLength:benchmarkFileSize];
+    arc4random_buf([benchmarkData mutableBytes], benchmarkFileSize);
+    NSString *benchmarkFileName = [NSString stringWithFormat:@"benchmark-%f.bin", [[NSDate date] timeIntervalSince1970]];
+    NSString *benchmarkFilePath = [NSTemporaryDirectory() stringByAppendingPathComponent:benchmarkFileName];
+    STAssertTrue([benchmarkData writeToFile:benchmarkFilePath atomically:NO], @"Unable to write benchmark file");
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:benchmarkFileName];
+    DLSFTPRequest *request = [[DLSFTPUploadRequest alloc] initWithRemotePath:remotePath
+                                                                   localPath:benchmarkFilePath
+                                                                successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                    dispatch_semaphore_signal(semaphore);
+                                                                }
+                                                                failureBlock:^(NSError *error) {
+                                                                    localError = error;
+                                                                    dispatch_semaphore_signal(semaphore);
+                                                                }
+                                                               progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+
+    NSArray *windowSizes = @[ @0UL, @(8ul * 1024 * 1024), @(32ul * 1024 * 1024) ];
+    NSArray *bufferSizes = @[ @8192UL, @(32ul * 1024), @(256ul * 1024) ];
+    for (NSNumber *windowSize in windowSizes) {
+        for (NSNumber *bufferSize in bufferSizes) {
+            self.connection.channelWindowSize = [windowSize unsignedLongValue];
+            self.connection.transferBufferSize = [bufferSize unsignedLongValue];
+            NSString *localPath = [benchmarkFilePath stringByAppendingPathExtension:@"download"];
+            __block NSTimeInterval duration = 0.0;
+            request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                              localPath:localPath
+                                                                 resume:NO
+                                                           successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                               duration = [finishTime timeIntervalSinceDate:startTime];
+                                                               dispatch_semaphore_signal(semaphore);
+                                                           }
+                                                           failureBlock:^(NSError *error) {
+                                                               localError = error;
+                                                               dispatch_semaphore_signal(semaphore);
+                                                           }
+                                                          progressBlock:nil];
+            [self.connection submitRequest:request];
+            dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+            STAssertNil(localError, localError.localizedDescription);
+            NSLog(@"benchmark download window=%@ buffer=%@ bytes=%lu seconds=%.3f throughput=%.0f bytes/sec"
+                  , windowSize
+                  , bufferSize
+                  , (unsigned long)benchmarkFileSize
+                  , duration
+                  , duration > 0.0 ? benchmarkFileSize / duration : 0.0);
+            [[NSFileManager defaultManager] removeItemAtPath:localPath error:nil];
+        }
+    }
+
+    request = [[DLSFTPRemoveFileRequest alloc] initWithFilePath:remotePath
+                                                   successBlock:^{
+                                                       dispatch_semaphore_signal(semaphore);
+                                                   }
+                                                   failureBlock:^(NSError *error) {
+                                                       localError = error;
+                                                       dispatch_semaphore_signal(semaphore);
+                                                   }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+    [[NSFileManager defaultManager] removeItemAtPath:benchmarkFilePath error:nil];
+}
+#endif
+
+
+- (void)test13Batch {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    __block NSArray *localResults = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *directoryName = self.connectionInfo[@"directoryName"];
+    const NSUInteger directoryCount = 10;
+    NSMutableArray *requests = [NSMutableArray array];
+    for (NSUInteger i = 0; i < directoryCount; i++) {
+        NSString *fullPath = [basePath stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-%lu", directoryName, (unsigned long)i]];
+        [requests addObject:[[DLSFTPMakeDirectoryRequest alloc] initWithDirectoryPath:fullPath successBlock:nil failureBlock:nil]];
+        [requests addObject:[[DLSFTPRemoveDirectoryRequest alloc] initWithDirectoryPath:fullPath successBlock:nil failureBlock:nil]];
+    }
+    __block unsigned long long finishedCount = 0;
+    DLSFTPRequest *request = [[DLSFTPBatchRequest alloc] initWithRequests:requests
+                                                              successBlock:^(NSArray *results) {
+                                                                  localResults = results;
+                                                                  dispatch_semaphore_signal(semaphore);
+                                                              }
+                                                              failureBlock:^(NSError *error) {
+                                                                  localError = error;
+                                                                  dispatch_semaphore_signal(semaphore);
+                                                              }
+                                                             progressBlock:^(unsigned long long finished, unsigned long long total) {
+                                                                 // a coalesced report may land late, so keep the highest
+                                                                 finishedCount = MAX(finishedCount, finished);
+                                                             }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertEquals([localResults count], [requests count], @"Batch results do not match requests");
+    for (id result in localResults) {
+        STAssertEqualObjects(result, [NSNull null], @"Batched request failed: %@", result);
+    }
+    // the final count is reported before the success block
+    STAssertEquals(finishedCount, (unsigned long long)[requests count], @"Batch progress did not reach the request count");
+}
+
+- (void)test14DownloadToMemory {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    __block NSData *localData = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [self.testFilePath lastPathComponent];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    NSData *testData = [NSData dataWithContentsOfFile:self.testFilePath];
+
+    DLSFTPRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                 maximumLength:[testData length]
+                                                                  successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime, NSData *data) {
+                                                                      localData = data;
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      localError = error;
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                 progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertEqualObjects(localData, testData, @"Downloaded data does not match uploaded");
+
+    // one byte short of the file must fail without delivering data
+    localData = nil;
+    request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                  maximumLength:[testData length] - 1
+                                                   successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime, NSData *data) {
+                                                       localData = data;
+                                                       dispatch_semaphore_signal(semaphore);
+                                                   }
+                                                   failureBlock:^(NSError *error) {
+                                                       localError = error;
+                                                       dispatch_semaphore_signal(semaphore);
+                                                   }
+                                                  progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localData, @"Data larger than maximumLength was delivered");
+    STAssertEquals([localError code], (NSInteger)eSFTPClientErrorFileTooLarge, @"Expected a file too large error");
+}
+
+- (void)test15DownloadDigest {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    __block NSData *localDigest = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [self.testFilePath lastPathComponent];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    NSString *localFileName = [NSString stringWithFormat:@"testfile-%f.jpg", [[NSDate date] timeIntervalSince1970]];
+    NSString *localPath = [NSTemporaryDirectory() stringByAppendingPathComponent:localFileName];
+
+    DLSFTPRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                     localPath:localPath
+                                                                        resume:NO
+                                                                  successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                      localDigest = file.digest;
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      localError = error;
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                 progressBlock:nil];
+    request.hashAlgorithm = eSFTPClientHashAlgorithmSHA256;
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+
+    // the digest computed in flight must match hashing the file we uploaded earlier
+    DLSFTPHasher *hasher = [[DLSFTPHasher alloc] initWithAlgorithm:eSFTPClientHashAlgorithmSHA256];
+    unsigned long long testFileSize = [[[NSFileManager defaultManager] attributesOfItemAtPath:self.testFilePath error:nil] fileSize];
+    STAssertTrue([hasher updateWithContentsOfFile:self.testFilePath length:testFileSize], @"Unable to hash test file");
+    STAssertEqualObjects(localDigest, [hasher finish], @"Digest of downloaded data does not match uploaded file");
+}
+
+// uploads data to remotePath, returning any error
+- (NSError *)uploadData:(NSData *)data toPath:(NSString *)remotePath {
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *request = [[DLSFTPUploadRequest alloc] initWithRemotePath:remotePath
+                                                                        data:data
+                                                                successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                    dispatch_semaphore_signal(semaphore);
+                                                                }
+                                                                failureBlock:^(NSError *error) {
+                                                                    localError = error;
+                                                                    dispatch_semaphore_signal(semaphore);
+                                                                }
+                                                               progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    return localError;
+}
+
+// downloads remotePath into memory, or returns nil
+- (NSData *)dataAtPath:(NSString *)remotePath {
+    __block NSData *localData = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                 maximumLength:16 * 1024 * 1024
+                                                                  successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime, NSData *data) {
+                                                                      localData = data;
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                 progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    return localData;
+}
+
+// resumes uploading the test file over remotePath, returning the first progress reported
+- (unsigned long long)resumeUploadToPath:(NSString *)remotePath error:(NSError * __autoreleasing *)error {
+    __block NSError *localError = nil;
+    __block unsigned long long firstProgress = 0;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPUploadRequest *request = [[DLSFTPUploadRequest alloc] initWithRemotePath:remotePath
+                                                                         localPath:self.testFilePath
+                                                                            resume:YES
+                                                                      successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                          dispatch_semaphore_signal(semaphore);
+                                                                      }
+                                                                      failureBlock:^(NSError *error) {
+                                                                          localError = error;
+                                                                          dispatch_semaphore_signal(semaphore);
+                                                                      }
+                                                                     progressBlock:^(unsigned long long bytesReceived, unsigned long long bytesTotal) {
+                                                                         if (firstProgress == 0) {
+                                                                             firstProgress = bytesReceived;
+                                                                         }
+                                                                     }];
+    request.resumeVerificationLength = 4096;
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    if (error) {
+        *error = localError;
+    }
+    return firstProgress;
+}
+
+- (void)test16ResumeUpload {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [NSString stringWithFormat:@"resume-%@", [self.testFilePath lastPathComponent]];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    NSData *testData = [NSData dataWithContentsOfFile:self.testFilePath];
+    NSUInteger prefixLength = [testData length] / 2;
+
+    // an interrupted upload leaves the first half of the file
+    NSError *localError = [self uploadData:[testData subdataWithRange:NSMakeRange(0, prefixLength)] toPath:remotePath];
+    STAssertNil(localError, localError.localizedDescription);
+    unsigned long long firstProgress = [self resumeUploadToPath:remotePath error:&localError];
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertTrue(firstProgress > prefixLength, @"Upload restarted instead of resuming from %lu", (unsigned long)prefixLength);
+    STAssertEqualObjects([self dataAtPath:remotePath], testData, @"Resumed upload does not match local file");
+
+    // a remote prefix that differs from the local file is replaced, not appended to
+    NSMutableData *corruptPrefix = [[testData subdataWithRange:NSMakeRange(0, prefixLength)] mutableCopy];
+    ((uint8_t *)[corruptPrefix mutableBytes])[prefixLength - 1] ^= 0xFF;
+    localError = [self uploadData:corruptPrefix toPath:remotePath];
+    STAssertNil(localError, localError.localizedDescription);
+    firstProgress = [self resumeUploadToPath:remotePath error:&localError];
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertTrue(firstProgress <= prefixLength, @"Upload resumed after a mismatched prefix");
+    STAssertEqualObjects([self dataAtPath:remotePath], testData, @"Restarted upload does not match local file");
+
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *request = [[DLSFTPRemoveFileRequest alloc] initWithFilePath:remotePath
+                                                                  successBlock:^{
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+- (void)test17PriorityOvertakesQueuedRequests {
+    STAssertFalse([self.connection isConnected], @"Connection must not be connected");
+    // one channel, so requests queue behind the download
+    self.connection.sftpChannelCount = 1;
+    self.connection.transfersPerChannel = 1;
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+
+    // large enough that the download is still running when the interactive request is submitted
+    const NSUInteger largeFileSize = 32 * 1024 * 1024;
+    NSMutableData *largeData = [NSMutableData dataWithLength:largeFileSize];
+    arc4random_buf([largeData mutableBytes], largeFileSize);
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [NSString stringWithFormat:@"priority-%f.bin", [[NSDate date] timeIntervalSince1970]];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    localError = [self uploadData:largeData toPath:remotePath];
+    STAssertNil(localError, localError.localizedDescription);
+    NSString *localPath = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+
+    NSMutableArray *finished = [NSMutableArray array];
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *(^makeRequest)(NSString *) = ^DLSFTPRequest *(NSString *name) {
+        return [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:basePath
+                                                        successBlock:^(NSArray *array) {
+                                                            @synchronized(finished) {
+                                                                [finished addObject:name];
+                                                            }
+                                                            dispatch_semaphore_signal(semaphore);
+                                                        }
+                                                        failureBlock:^(NSError *error) {
+                                                            localError = error;
+                                                            dispatch_semaphore_signal(semaphore);
+                                                        }];
+    };
+
+    dispatch_semaphore_t downloadStarted = dispatch_semaphore_create(0);
+    __block BOOL reportedStart = NO;
+    __block unsigned long long bytesWhenOvertaken = 0;
+    __block unsigned long long downloadedBytes = 0;
+    DLSFTPRequest *download = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                      localPath:localPath
+                                                                         resume:NO
+                                                                   successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                       @synchronized(finished) {
+                                                                           [finished addObject:@"download"];
+                                                                       }
+                                                                       dispatch_semaphore_signal(semaphore);
+                                                                   }
+                                                                   failureBlock:^(NSError *error) {
+                                                                       localError = error;
+                                                                       dispatch_semaphore_signal(semaphore);
+                                                                   }
+                                                                  progressBlock:^(unsigned long long bytesReceived, unsigned long long bytesTotal) {
+                                                                      @synchronized(finished) {
+                                                                          downloadedBytes = bytesReceived;
+                                                                      }
+                                                                      if (reportedStart == NO) {
+                                                                          reportedStart = YES;
+                                                                          dispatch_semaphore_signal(downloadStarted);
+                                                                      }
+                                                                  }];
+    download.priority = eSFTPClientRequestPriorityBulk;
+    [self.connection submitRequest:download];
+    NSArray *bulkNames = @[ @"bulk1", @"bulk2", @"bulk3" ];
+    for (NSString *name in bulkNames) {
+        DLSFTPRequest *request = makeRequest(name);
+        request.priority = eSFTPClientRequestPriorityBulk;
+        [self.connection submitRequest:request];
+    }
+    // submitted only once the download holds the channel, so finishing first means it preempted
+    dispatch_semaphore_wait(downloadStarted, DISPATCH_TIME_FOREVER);
+    DLSFTPRequest *interactive = [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:basePath
+                                                                          successBlock:^(NSArray *array) {
+                                                                              @synchronized(finished) {
+                                                                                  [finished addObject:@"interactive"];
+                                                                                  bytesWhenOvertaken = downloadedBytes;
+                                                                              }
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }];
+    interactive.priority = eSFTPClientRequestPriorityInteractive;
+    [self.connection submitRequest:interactive];
+
+    for (NSUInteger count = 0; count < [bulkNames count] + 2; count++) {
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    }
+    STAssertNil(localError, localError.localizedDescription);
+    NSUInteger interactiveIndex = [finished indexOfObject:@"interactive"];
+    STAssertEquals(interactiveIndex, (NSUInteger)0, @"Interactive request should finish first, preempting the download: %@", finished);
+    STAssertTrue(bytesWhenOvertaken < largeFileSize, @"Interactive request finished after the download had completed");
+    NSArray *bulkOrder = [finished filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'bulk'"]];
+    STAssertEqualObjects(bulkOrder, bulkNames, @"Requests of the same priority should finish in the order submitted");
+    [[NSFileManager defaultManager] removeItemAtPath:localPath error:nil];
+
+    DLSFTPRequest *request = [[DLSFTPRemoveFileRequest alloc] initWithFilePath:remotePath
+                                                                  successBlock:^{
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+- (void)test18CancelBlockedStream {
+    STAssertFalse([self.connection isConnected], @"Connection must not be connected");
+    // one channel, so the listing can only run once the stream releases it
+    self.connection.sftpChannelCount = 1;
+    self.connection.transfersPerChannel = 1;
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    __block NSUInteger chunkCount = 0;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t consumerBlocked = dispatch_semaphore_create(0);
+    dispatch_semaphore_t consumerRelease = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [self.testFilePath lastPathComponent];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    DLSFTPDownloadRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                             dataBlock:^(dispatch_data_t data) {
+                                                                                 chunkCount++;
+                                                                                 if (chunkCount == 1) {
+                                                                                     // a consumer that stops consuming
+                                                                                     dispatch_semaphore_signal(consumerBlocked);
+                                                                                     dispatch_semaphore_wait(consumerRelease, DISPATCH_TIME_FOREVER);
+                                                                                 }
+                                                                             }
+                                                                          successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                         progressBlock:nil];
+    // pause reading after the first chunk
+    request.maximumBytesInFlight = 1;
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(consumerBlocked, DISPATCH_TIME_FOREVER);
+    [request cancel];
+
+    // the channel is released while the consumer is still blocked
+    __block NSError *listError = nil;
+    dispatch_semaphore_t listed = dispatch_semaphore_create(0);
+    DLSFTPRequest *listRequest = [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:basePath
+                                                                          successBlock:^(NSArray *array) {
+                                                                              dispatch_semaphore_signal(listed);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              listError = error;
+                                                                              dispatch_semaphore_signal(listed);
+                                                                          }];
+    [self.connection submitRequest:listRequest];
+    long timedOut = dispatch_semaphore_wait(listed, dispatch_time(DISPATCH_TIME_NOW, 30 * NSEC_PER_SEC));
+    STAssertEquals(timedOut, 0L, @"Cancelled stream kept its channel while the consumer was blocked");
+    STAssertNil(listError, listError.localizedDescription);
+
+    // the failure follows the chunk being consumed
+    dispatch_semaphore_signal(consumerRelease);
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertEquals(localError.code, (NSInteger)eSFTPClientErrorCancelledByUser, @"Expecting cancelled by user but got %@", localError);
+}
+
+
+// removes remotePath, ignoring errors
+- (void)removeRemotePath:(NSString *)remotePath {
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *request = [[DLSFTPRemoveFileRequest alloc] initWithFilePath:remotePath
+                                                                  successBlock:^{
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }
+                                                                  failureBlock:^(NSError *error) {
+                                                                      dispatch_semaphore_signal(semaphore);
+                                                                  }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+// lists basePath, returning any error
+- (NSError *)listBasePath {
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *request = [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:self.connectionInfo[@"basePath"]
+                                                                      successBlock:^(NSArray *array) {
+                                                                          dispatch_semaphore_signal(semaphore);
+                                                                      }
+                                                                      failureBlock:^(NSError *error) {
+                                                                          localError = error;
+                                                                          dispatch_semaphore_signal(semaphore);
+                                                                      }];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    return localError;
+}
+
+- (void)test19TimeoutRestartsChannel {
+    STAssertFalse([self.connection isConnected], @"Connection must not be connected");
+    // one channel, so the requests after the timeout run on the restarted one
+    self.connection.sftpChannelCount = 1;
+    self.connection.transfersPerChannel = 1;
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t consumerRelease = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [self.testFilePath lastPathComponent];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    // the consumer holds up the stream until well past the timeout
+    DLSFTPDownloadRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                             dataBlock:^(dispatch_data_t data) {
+                                                                                 dispatch_semaphore_wait(consumerRelease, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC));
+                                                                             }
+                                                                          successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                         progressBlock:nil];
+    request.maximumBytesInFlight = 1;
+    request.timeout = 0.5;
+    [self.connection submitRequest:request];
+
+    // the channel is free again once the timeout stops the request
+    NSError *listError = [self listBasePath];
+    STAssertNil(listError, @"Listing after a timeout failed: %@", listError);
+    dispatch_semaphore_signal(consumerRelease);
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertEquals(localError.code, (NSInteger)eSFTPClientErrorRequestTimedOut, @"Expecting a timeout but got %@", localError);
+    STAssertTrue(request.isTimedOut, @"Request should report that it timed out");
+
+    // and transfers whole files on its restarted sftp session
+    NSData *testData = [NSData dataWithContentsOfFile:self.testFilePath];
+    STAssertEqualObjects([self dataAtPath:remotePath], testData, @"Download after a timeout does not match the test file");
+}
+
+
+- (void)test20DependencyAndCancellationResults {
+    STAssertFalse([self.connection isConnected], @"Connection must not be connected");
+    self.connection.sftpChannelCount = 1;
+    self.connection.transfersPerChannel = 1;
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPRequest *(^makeRequest)(NSString *, NSString *) = ^DLSFTPRequest *(NSString *name, NSString *path) {
+        return [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:path
+                                                        successBlock:^(NSArray *array) {
+                                                            @synchronized(errors) {
+                                                                errors[name] = [NSNull null];
+                                                            }
+                                                            dispatch_semaphore_signal(semaphore);
+                                                        }
+                                                        failureBlock:^(NSError *error) {
+                                                            @synchronized(errors) {
+                                                                errors[name] = error;
+                                                            }
+                                                            dispatch_semaphore_signal(semaphore);
+                                                        }];
+    };
+
+    // a failed dependency fails its dependent
+    NSString *missingPath = [basePath stringByAppendingPathComponent:[NSString stringWithFormat:@"missing-%f", [[NSDate date] timeIntervalSince1970]]];
+    DLSFTPRequest *failing = makeRequest(@"failing", missingPath);
+    DLSFTPRequest *afterFailing = makeRequest(@"afterFailing", basePath);
+    [afterFailing addDependency:failing];
+    // as does one never submitted
+    DLSFTPRequest *unsubmitted = makeRequest(@"unsubmitted", basePath);
+    DLSFTPRequest *afterUnsubmitted = makeRequest(@"afterUnsubmitted", basePath);
+    [afterUnsubmitted addDependency:unsubmitted];
+    [self.connection submitRequest:failing];
+    [self.connection submitRequest:afterFailing];
+    [self.connection submitRequest:afterUnsubmitted];
+    for (NSUInteger count = 0; count < 3; count++) {
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    }
+    STAssertTrue([errors[@"failing"] isKindOfClass:[NSError class]], @"Listing a missing directory should fail");
+    STAssertEquals([errors[@"afterFailing"] code], (NSInteger)eSFTPClientErrorDependencyFailed, @"Expecting dependency failed but got %@", errors[@"afterFailing"]);
+    STAssertEquals([errors[@"afterUnsubmitted"] code], (NSInteger)eSFTPClientErrorDependencyFailed, @"Expecting dependency failed but got %@", errors[@"afterUnsubmitted"]);
+
+    // requests queued behind a running one, and their dependents, all get a result when everything is cancelled
+    dispatch_semaphore_t consumerBlocked = dispatch_semaphore_create(0);
+    dispatch_semaphore_t consumerRelease = dispatch_semaphore_create(0);
+    NSString *remotePath = [basePath stringByAppendingPathComponent:[self.testFilePath lastPathComponent]];
+    __block BOOL blocked = NO;
+    DLSFTPDownloadRequest *stream = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                            dataBlock:^(dispatch_data_t data) {
+                                                                                if (blocked == NO) {
+                                                                                    blocked = YES;
+                                                                                    dispatch_semaphore_signal(consumerBlocked);
+                                                                                    dispatch_semaphore_wait(consumerRelease, DISPATCH_TIME_FOREVER);
+                                                                                }
+                                                                            }
+                                                                         successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                             dispatch_semaphore_signal(semaphore);
+                                                                         }
+                                                                         failureBlock:^(NSError *error) {
+                                                                             @synchronized(errors) {
+                                                                                 errors[@"stream"] = error;
+                                                                             }
+                                                                             dispatch_semaphore_signal(semaphore);
+                                                                         }
+                                                                        progressBlock:nil];
+    stream.maximumBytesInFlight = 1;
+    [self.connection submitRequest:stream];
+    dispatch_semaphore_wait(consumerBlocked, DISPATCH_TIME_FOREVER);
+    DLSFTPRequest *queued = makeRequest(@"queued", basePath);
+    DLSFTPRequest *afterQueued = makeRequest(@"afterQueued", basePath);
+    [afterQueued addDependency:queued];
+    [self.connection submitRequest:queued];
+    [self.connection submitRequest:afterQueued];
+    [self.connection cancelAllRequests];
+    dispatch_semaphore_signal(consumerRelease);
+    for (NSUInteger count = 0; count < 3; count++) {
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    }
+    STAssertEquals([errors[@"stream"] code], (NSInteger)eSFTPClientErrorCancelledByUser, @"Expecting cancelled by user but got %@", errors[@"stream"]);
+    STAssertEquals([errors[@"queued"] code], (NSInteger)eSFTPClientErrorCancelledByUser, @"Expecting cancelled by user but got %@", errors[@"queued"]);
+    STAssertTrue([errors[@"afterQueued"] isKindOfClass:[NSError class]], @"Dependent of a cancelled request should fail");
+}
+
+
+- (void)test21DownloadPausesForSlowWrites {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    const NSUInteger largeFileSize = 8 * 1024 * 1024;
+    NSMutableData *largeData = [NSMutableData dataWithLength:largeFileSize];
+    arc4random_buf([largeData mutableBytes], largeFileSize);
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [NSString stringWithFormat:@"backpressure-%f.bin", [[NSDate date] timeIntervalSince1970]];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    localError = [self uploadData:largeData toPath:remotePath];
+    STAssertNil(localError, localError.localizedDescription);
+    NSString *localPath = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+
+    DLSFTPDownloadRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                             localPath:localPath
+                                                                                resume:NO
+                                                                          successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                         progressBlock:nil];
+    // every read is written on its own and pauses reading until it is
+    request.maximumBytesInFlight = 1;
+    request.writeSize = 0;
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+
+    STAssertEqualObjects([NSData dataWithContentsOfFile:localPath], largeData, @"Contents of downloaded file do not match uploaded");
+    STAssertTrue(request.readPauseCount > 0, @"Reading never paused for writes");
+    // at most one read lands past the limit before reading pauses
+    unsigned long long limit = request.maximumBytesInFlight + self.connection.transferBufferSize;
+    STAssertTrue(request.peakBytesInFlight <= limit, @"%llu bytes in flight exceeds %llu", request.peakBytesInFlight, limit);
+
+    [[NSFileManager defaultManager] removeItemAtPath:localPath error:nil];
+    [self removeRemotePath:remotePath];
+}
+
+
+- (void)test22StreamDelivery {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    __block NSUInteger lengthAtSuccess = 0;
+    NSMutableData *receivedData = [NSMutableData data];
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [self.testFilePath lastPathComponent];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    DLSFTPDownloadRequest *request = [[DLSFTPDownloadRequest alloc] initWithRemotePath:remotePath
+                                                                             dataBlock:^(dispatch_data_t data) {
+                                                                                 dispatch_data_apply(data, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+                                                                                     [receivedData appendBytes:buffer length:size];
+                                                                                     return true;
+                                                                                 });
+                                                                             }
+                                                                          successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                              lengthAtSuccess = [receivedData length];
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                         progressBlock:nil];
+    // small enough that reading pauses for the consumer
+    request.maximumBytesInFlight = 1;
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+
+    // every chunk is delivered, in order, before success
+    NSData *testData = [NSData dataWithContentsOfFile:self.testFilePath];
+    STAssertEquals(lengthAtSuccess, [testData length], @"Success reported before all chunks were delivered");
+    STAssertEqualObjects(receivedData, testData, @"Streamed data does not match the test file");
+}
+
+
+- (void)test23UploadFromMemorySources {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    DLSFTPClientFileTransferSuccessBlock successBlock = ^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+        dispatch_semaphore_signal(semaphore);
+    };
+    DLSFTPClientFailureBlock failureBlock = ^(NSError *error) {
+        localError = error;
+        dispatch_semaphore_signal(semaphore);
+    };
+
+    // larger than a transfer buffer, so several reads and writes are needed
+    const NSUInteger dataSize = 3 * 1024 * 1024 + 17;
+    NSMutableData *testData = [NSMutableData dataWithLength:dataSize];
+    arc4random_buf([testData mutableBytes], dataSize);
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSTimeInterval timestamp = [[NSDate date] timeIntervalSince1970];
+
+    // a stream of unknown length
+    NSString *streamPath = [basePath stringByAppendingPathComponent:[NSString stringWithFormat:@"stream-%f.bin", timestamp]];
+    DLSFTPRequest *request = [[DLSFTPUploadRequest alloc] initWithRemotePath:streamPath
+                                                                 inputStream:[NSInputStream inputStreamWithData:testData]
+                                                                successBlock:successBlock
+                                                                failureBlock:failureBlock
+                                                               progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertEqualObjects([self dataAtPath:streamPath], testData, @"Upload from an input stream does not match");
+
+    // dispatch data made of more than one region
+    NSString *dispatchPath = [basePath stringByAppendingPathComponent:[NSString stringWithFormat:@"dispatch-%f.bin", timestamp]];
+    const size_t splitOffset = 1024 * 1024 + 5;
+    dispatch_data_t head = dispatch_data_create([testData bytes], splitOffset, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+    dispatch_data_t tail = dispatch_data_create((const char *)[testData bytes] + splitOffset, dataSize - splitOffset, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+    dispatch_data_t dispatchData = dispatch_data_create_concat(head, tail);
+    request = [[DLSFTPUploadRequest alloc] initWithRemotePath:dispatchPath
+                                                 dispatchData:dispatchData
+                                                 successBlock:successBlock
+                                                 failureBlock:failureBlock
+                                                progressBlock:nil];
+    [self.connection submitRequest:request];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNil(localError, localError.localizedDescription);
+    STAssertEqualObjects([self dataAtPath:dispatchPath], testData, @"Upload from dispatch data does not match");
+
+    [self removeRemotePath:streamPath];
+    [self removeRemotePath:dispatchPath];
+}
+
+
+- (void)test24AtomicUploadReplacesTarget {
+    [self test01Connect];
+    STAssertTrue([self.connection isConnected], @"Not connected");
+    __block NSError *localError = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+
+    NSString *basePath = self.connectionInfo[@"basePath"];
+    NSString *fileName = [NSString stringWithFormat:@"atomic-%f.txt", [[NSDate date] timeIntervalSince1970]];
+    NSString *remotePath = [basePath stringByAppendingPathComponent:fileName];
+    NSString *backupName = [NSString stringWithFormat:@".%@.orig", fileName];
+    NSString *partName = [NSString stringWithFormat:@".%@.part", fileName];
+    NSError *(^uploadAtomically)(NSData *) = ^NSError *(NSData *data) {
+        localError = nil;
+        DLSFTPUploadRequest *request = [[DLSFTPUploadRequest alloc] initWithRemotePath:remotePath
+                                                                                  data:data
+                                                                          successBlock:^(DLSFTPFile *file, NSDate *startTime, NSDate *finishTime) {
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *error) {
+                                                                              localError = error;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                         progressBlock:nil];
+        request.uploadsAtomically = YES;
+        [self.connection submitRequest:request];
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+        return localError;
+    };
+
+    // replacing an existing target
+    NSData *version1 = [@"version 1" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *version2 = [@"version 2, longer than the first" dataUsingEncoding:NSUTF8StringEncoding];
+    NSError *error = [self uploadData:version1 toPath:remotePath];
+    STAssertNil(error, error.localizedDescription);
+    error = uploadAtomically(version2);
+    STAssertNil(error, error.localizedDescription);
+    STAssertEqualObjects([self dataAtPath:remotePath], version2, @"Atomic upload did not replace the existing file");
+
+    // a backup left by an earlier upload doesn't block the rename
+    NSString *backupPath = [basePath stringByAppendingPathComponent:backupName];
+    error = [self uploadData:[@"stale backup" dataUsingEncoding:NSUTF8StringEncoding] toPath:backupPath];
+    STAssertNil(error, error.localizedDescription);
+    NSData *version3 = [@"v3" dataUsingEncoding:NSUTF8StringEncoding];
+    error = uploadAtomically(version3);
+    STAssertNil(error, error.localizedDescription);
+    STAssertEqualObjects([self dataAtPath:remotePath], version3, @"Atomic upload failed to replace the file over a stale backup");
+
+    // and neither hidden sibling is left behind
+    __block NSArray *fileNames = nil;
+    DLSFTPRequest *listRequest = [[DLSFTPListFilesRequest alloc] initWithDirectoryPath:basePath
+                                                                          successBlock:^(NSArray *array) {
+                                                                              fileNames = [array valueForKeyPath:@"path.lastPathComponent"];
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }
+                                                                          failureBlock:^(NSError *listError) {
+                                                                              localError = listError;
+                                                                              dispatch_semaphore_signal(semaphore);
+                                                                          }];
+    [self.connection submitRequest:listRequest];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    STAssertNotNil(fileNames, localError.localizedDescription);
+    STAssertTrue([fileNames containsObject:fileName], @"Uploaded file missing from listing");
+    STAssertFalse([fileNames containsObject:backupName], @"Backup of the replaced file was left behind");
+    STAssertFalse([fileNames containsObject:partName], @"Partial upload was left behind");
+
+    [self removeRemotePath:remotePath];
+    [self removeRemotePath:backupPath];
+}
+
 @end
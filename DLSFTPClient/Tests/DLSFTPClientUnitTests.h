@@ -0,0 +1,14 @@
+//
+//  DLSFTPClientUnitTests.h
+//  DLSFTPClient
+//
+//  Created by Dan Leehr on 10/18/26.
+//  Copyright (c) 2026 Dan Leehr. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+// Tests of the classes that don't need a server
+@interface DLSFTPClientUnitTests : SenTestCase
+
+@end